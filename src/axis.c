@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Fixed point analog axis operations.
+
+All the gamepad axes are carried as Q15 integers from the moment they are
+produced (thumbstick, gyro, buttons mapped to axes) until they are written
+into the HID report, so the per-tick combining, deadzone and range conversions
+do not need (software emulated) floating point.
+
+Conversions truncate towards zero like the float-to-int casts used before, so
+the reported values match the float pipeline within 2 units (out of 32767).
+The ramps can add the rounding of their factor multiplied by their slope (eg:
+2 more units for ramp_mid with a 0.25 factor).
+
+This file does not depend on the Pico SDK, so it can be compiled on a host.
+*/
+
+#include "axis.h"
+
+Axis axis_from_float(float value) {
+    if (value >= 1) return AXIS_MAX;
+    if (value <= -1) return AXIS_MIN;
+    return (Axis)(value * AXIS_MAX);
+}
+
+float axis_to_float(Axis value) {
+    return (float)value / AXIS_MAX;
+}
+
+Axis axis_saturate(int32_t value) {
+    if (value > AXIS_MAX) return AXIS_MAX;
+    if (value < AXIS_MIN) return AXIS_MIN;
+    return value;
+}
+
+Axis axis_add(Axis a, Axis b) {
+    return axis_saturate((int32_t)a + b);
+}
+
+Axis axis_neg(Axis value) {
+    return axis_saturate(-(int32_t)value);
+}
+
+Axis axis_abs(Axis value) {
+    return value < 0 ? axis_neg(value) : value;
+}
+
+Axis axis_mul(Axis a, Axis b) {
+    return axis_saturate(((int32_t)a * b) / AXIS_MAX);
+}
+
+// Deadzone in the lower part of the range, see ramp_low in common.h.
+Axis axis_ramp_low(Axis value, Axis k) {
+    if (value < k) return 0;
+    if (k >= AXIS_MAX) return AXIS_MAX;
+    return axis_saturate(((int32_t)(value - k) * AXIS_MAX) / (AXIS_MAX - k));
+}
+
+// Deadzone in both the lower and upper part of the range, see ramp_mid in
+// common.h.
+Axis axis_ramp_mid(Axis value, Axis k) {
+    if (value < k) return 0;
+    if (value > (AXIS_MAX - k)) return AXIS_MAX;
+    return axis_saturate(((int32_t)(value - k) * AXIS_MAX) / (AXIS_MAX - (2 * k)));
+}
+
+// Trigger from [0, 1] into the full signed range [-32767, 32767].
+int16_t axis_to_trigger_signed(Axis value) {
+    if (value < 0) value = 0;
+    return (2 * (int32_t)value) - AXIS_MAX;
+}
+
+// Trigger from [0, 1] into [0, 255].
+uint8_t axis_to_trigger(Axis value) {
+    if (value < 0) value = 0;
+    return ((int32_t)value * AXIS_TRIGGER_MAX) / AXIS_MAX;
+}
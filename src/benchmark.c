@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Benchmark of the per-tick cost of each of the default profiles.
+
+Every profile is made to report a number of times in a row (as the main loop
+would do, including the sensor sampling and the HID report handling) and the
+average and worst durations are compared against the tick interval, so it can be verified if the current
+tick frequency (see CFG_TICK_1KHZ) fits reliably.
+
+Then the building of the HID reports from the key state is measured on its
+own, with a worst case of pressed keys (all keycode words populated, every
+modifier and every gamepad button).
+
+If the IMU FIFO is enabled (single core only), the CPU time of reading the
+gyro FIFOs (and the accelerometers) with blocking SPI is compared against the
+DMA path (CFG_IMU_ASYNC), with one tick interval between reads so the FIFOs
+hold a tick of samples. The DMA path includes the time spent in the DMA
+interrupt, that starts each transfer of the sequence.
+
+Then the cost in CPU cycles of the vector and quaternion functions used by
+the absolute gyro mode is measured.
+
+Finally the thumbstick filter is replayed on a synthetic trace (the stick at
+rest with ADC-like noise, then a flick to the edge), reporting the remaining
+jitter at rest and the latency added to the flick, compared with no filter.
+
+The controller should be left untouched while running, since the generated
+reports are discarded (or sent unchanged, if the host is polling).
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <pico/stdlib.h>
+#include <hardware/clocks.h>
+#include "benchmark.h"
+#include "config.h"
+#include "gyro.h"
+#include "hid.h"
+#include "imu.h"
+#include "bus.h"
+#include "pin.h"
+#include "polar.h"
+#include "profile.h"
+#include "sampler.h"
+#include "thumbstick.h"
+#include "vector.h"
+#include "logging.h"
+#include "common.h"
+
+void benchmark_profile(uint8_t index, uint32_t budget) {
+    Profile *profile = profile_get(index);
+    CtrlProfile *profile_cfg = config_profile_read(index);
+    uint64_t total = 0;
+    uint32_t worst = 0;
+    for(uint16_t i=0; i<BENCHMARK_TICKS; i++) {
+        uint32_t start = time_us_32();
+        sampler_update();
+        profile->report(profile);
+        hid_report();
+        uint32_t elapsed = time_us_32() - start;
+        total += elapsed;
+        worst = max(worst, elapsed);
+        hid_report_discard();
+        hid_gamepad_reset();
+    }
+    profile->reset(profile);
+    info(
+        "  %-16s avg=%4lu max=%4lu (us) %s\n",
+        profile_cfg->sections[SECTION_NAME].name.name,
+        (uint32_t)(total / BENCHMARK_TICKS),
+        worst,
+        worst < budget ? "OK" : "OVER"
+    );
+}
+
+void benchmark_reports() {
+    uint8_t keys[] = {
+        KEY_A, KEY_Z, KEY_SPACE, KEY_F12, KEY_PAD_9, KEY_F24,
+        KEY_CONTROL_LEFT, KEY_SHIFT_LEFT, KEY_ALT_LEFT, KEY_SUPER_LEFT,
+        KEY_CONTROL_RIGHT, KEY_SHIFT_RIGHT, KEY_ALT_RIGHT, KEY_SUPER_RIGHT,
+        MOUSE_1, MOUSE_2,
+    };
+    for(uint8_t i=0; i<sizeof(keys); i++) hid_press(keys[i]);
+    for(uint8_t i=GAMEPAD_INDEX; i<=GAMEPAD_INDEX_END; i++) hid_press(i);
+    uint64_t total = 0;
+    uint32_t worst = 0;
+    for(uint16_t i=0; i<BENCHMARK_TICKS; i++) {
+        uint32_t start = time_us_32();
+        hid_keyboard_queue();
+        hid_mouse_queue();
+        hid_gamepad_queue();
+        uint32_t elapsed = time_us_32() - start;
+        total += elapsed;
+        worst = max(worst, elapsed);
+        hid_report_discard();
+    }
+    info(
+        "  %-16s avg=%4lu max=%4lu (us)\n",
+        "Report building",
+        (uint32_t)(total / BENCHMARK_TICKS),
+        worst
+    );
+}
+
+uint32_t benchmark_imu_path(bool async, uint32_t interval) {
+    uint64_t total = 0;
+    Vector imu1;
+    Vector accel;
+    uint32_t irq_start = bus_spi_get_irq_time();
+    for(uint16_t i=0; i<BENCHMARK_IMU_TICKS; i++) {
+        uint32_t start = time_us_32();
+        if (async) {
+            imu_read_gyro_async(&imu1, &accel);
+        } else {
+            imu_read_gyro_fifo(PIN_SPI_CS0);
+            imu_read_gyro_fifo(PIN_SPI_CS1);
+            imu_read_accel_bits(PIN_SPI_CS0);
+            imu_read_accel_bits(PIN_SPI_CS1);
+        }
+        uint32_t elapsed = time_us_32() - start;
+        total += elapsed;
+        sleep_us(interval - min(elapsed, interval));
+    }
+    bus_spi_wait();
+    total += bus_spi_get_irq_time() - irq_start;
+    return total / BENCHMARK_IMU_TICKS;
+}
+
+void benchmark_imu(uint32_t interval) {
+    if (!CFG_IMU_FIFO || CFG_DUAL_CORE) return;
+    uint32_t blocking = benchmark_imu_path(false, interval);
+    uint32_t async = benchmark_imu_path(true, interval);
+    info("  %-16s blocking=%4lu async=%4lu (us)\n", "IMU FIFO read", blocking, async);
+}
+
+// Results are accumulated into a volatile, so the calls are not optimized out.
+volatile float benchmark_sink;
+
+void benchmark_vector_log(char *name, uint32_t start) {
+    uint32_t elapsed = time_us_32() - start;
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    info("  %-16s %5lu cycles\n", name, (elapsed * mhz) / BENCHMARK_VECTOR_CALLS);
+}
+
+void benchmark_vector() {
+    Vector a = {0.3f, -0.5f, 0.8f};
+    Vector b = {-0.7f, 0.1f, 0.2f};
+    Vector4 q = quaternion(a, 0.01f);
+    uint32_t start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += vector_normalize(a).x;
+    }
+    benchmark_vector_log("vector_normalize", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += vector_cross_product(a, b).x;
+    }
+    benchmark_vector_log("vector_cross", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += quaternion(a, benchmark_sink).r;
+    }
+    benchmark_vector_log("quaternion", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += qmultiply(q, q).r;
+    }
+    benchmark_vector_log("qmultiply", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += qrotate(q, b).x;
+    }
+    benchmark_vector_log("qrotate", start);
+    // Whole orientation filter step (absolute gyro mode), at rest.
+    Vector gyro = {10, -20, 5};
+    Vector accel = {0, 0, BIT_14};
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        gyro_orientation_update(gyro, accel, CFG_GYRO_DT_REFERENCE);
+    }
+    benchmark_vector_log("orientation", start);
+    gyro_orientation_reset();
+    // Thumbstick polar conversion, fixed point against the float functions.
+    int32_t x = 12000;
+    int32_t y = -23000;
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += polar_magnitude(x, y + i);
+    }
+    benchmark_vector_log("polar_magnitude", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += polar_angle_ge(x, y + i, POLAR_SLOPE_22_5);
+    }
+    benchmark_vector_log("polar_angle_ge", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += sqrtf((float)(x * x) + (float)((y + i) * (y + i)));
+    }
+    benchmark_vector_log("sqrtf", start);
+    start = time_us_32();
+    for(uint16_t i=0; i<BENCHMARK_VECTOR_CALLS; i++) {
+        benchmark_sink += atan2f(x, -(y + i));
+    }
+    benchmark_vector_log("atan2f", start);
+}
+
+// Deterministic noise in the range -amplitude to +amplitude.
+float benchmark_noise(uint32_t *seed, float amplitude) {
+    *seed = (*seed * 1664525) + 1013904223;
+    return (((float)(*seed >> 8) / (1 << 24)) * 2 - 1) * amplitude;
+}
+
+void benchmark_thumbstick_filter() {
+    ThumbstickFilter filter = {
+        .min_cutoff = BENCHMARK_FILTER_CUTOFF,
+        .beta = BENCHMARK_FILTER_BETA,
+    };
+    thumbstick_filter_reset(&filter);
+    uint32_t dt = 1000000 / CFG_TICK_FREQUENCY;
+    uint32_t seed = 1;
+    float noise_in = 0;
+    float noise_out = 0;
+    uint16_t latency = 0;
+    uint32_t elapsed = 0;
+    for(uint16_t i=0; i<BENCHMARK_FILTER_TICKS*2; i++) {
+        bool rest = i < BENCHMARK_FILTER_TICKS;
+        float x = (rest ? 0 : 1) + benchmark_noise(&seed, BENCHMARK_FILTER_NOISE);
+        float y = benchmark_noise(&seed, BENCHMARK_FILTER_NOISE);
+        float input = x;
+        uint32_t start = time_us_32();
+        thumbstick_filter(&filter, &x, &y, dt);
+        elapsed += time_us_32() - start;
+        if (rest) {
+            noise_in += input * input;
+            noise_out += x * x;
+        }
+        else if (x < 0.9 && latency == i - BENCHMARK_FILTER_TICKS) latency++;
+    }
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    info("  %-16s jitter=%.5f (raw %.5f) latency=%u ms %lu cycles\n",
+        "Thumbstick filter",
+        sqrtf(noise_out / BENCHMARK_FILTER_TICKS),
+        sqrtf(noise_in / BENCHMARK_FILTER_TICKS),
+        latency * CFG_TICK_INTERVAL,
+        (elapsed * mhz) / (BENCHMARK_FILTER_TICKS * 2)
+    );
+}
+
+void benchmark() {
+    uint32_t budget = 1000000 / CFG_TICK_FREQUENCY;
+    info("Benchmark: %i ticks per profile at %iHz (budget %lu us)\n",
+        BENCHMARK_TICKS,
+        CFG_TICK_FREQUENCY,
+        budget
+    );
+    for(uint8_t i=PROFILE_HOME; i<=PROFILE_RTS; i++) {
+        benchmark_profile(i, budget);
+    }
+    benchmark_reports();
+    benchmark_imu(budget);
+    benchmark_vector();
+    benchmark_thumbstick_filter();
+    // Discard any state generated during the benchmark.
+    hid_matrix_reset();
+    info("Benchmark: completed\n");
+}
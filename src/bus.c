@@ -6,6 +6,8 @@
 #include <hardware/gpio.h>
 #include <hardware/i2c.h>
 #include <hardware/spi.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
 #include "bus.h"
 #include "config.h"
 #include "pin.h"
@@ -15,6 +17,15 @@
 uint16_t io_cache_0;
 uint16_t io_cache_1;
 
+// Asynchronous SPI reads.
+int bus_spi_dma_tx;
+int bus_spi_dma_rx;
+volatile bool bus_spi_busy = false;
+uint8_t bus_spi_async_cs;
+BusSpiCallback bus_spi_async_callback;
+const uint8_t bus_spi_zero = 0;
+uint32_t bus_spi_irq_time = 0;  // Microseconds spent in the DMA interrupt.
+
 int8_t bus_i2c_acknowledge(uint8_t device) {
     uint8_t buf = 0;
     return i2c_read_blocking(i2c1, device, &buf, 1, false);
@@ -75,14 +86,22 @@ bool bus_i2c_io_read(uint8_t device_id, uint8_t bit_index) {
     return value & (1 << bit_index);
 }
 
+// Wait until any asynchronous transfer (and the ones chained to it from its
+// callback) is completed, so the blocking functions get exclusive access.
+void bus_spi_wait() {
+    while(bus_spi_busy) tight_loop_contents();
+}
+
 void bus_spi_write(uint8_t cs, uint8_t reg, uint8_t value) {
+    bus_spi_wait();
     gpio_put(cs, false);
     uint8_t buf[] = {reg, value};
     spi_write_blocking(spi1, buf, 2);
     gpio_put(cs, true);
 }
 
-void bus_spi_read(uint8_t cs, uint8_t reg, uint8_t *buf, uint8_t size) {
+void bus_spi_read(uint8_t cs, uint8_t reg, uint8_t *buf, uint16_t size) {
+    bus_spi_wait();
     gpio_put(cs, false);
     reg |= 0b10000000;  // Read byte.
     spi_write_blocking(spi1, &reg, 1);
@@ -90,6 +109,44 @@ void bus_spi_read(uint8_t cs, uint8_t reg, uint8_t *buf, uint8_t size) {
     gpio_put(cs, true);
 }
 
+// Read SIZE bytes with DMA, CALLBACK is called from the DMA interrupt once the
+// chip select is released, and can start the next transfer.
+bool bus_spi_read_async(
+    uint8_t cs,
+    uint8_t reg,
+    uint8_t *buf,
+    uint16_t size,
+    BusSpiCallback callback
+) {
+    if (bus_spi_busy) return false;
+    bus_spi_busy = true;
+    bus_spi_async_cs = cs;
+    bus_spi_async_callback = callback;
+    gpio_put(cs, false);
+    reg |= 0b10000000;  // Read byte.
+    spi_write_blocking(spi1, &reg, 1);  // Also drains the RX FIFO.
+    dma_channel_set_write_addr(bus_spi_dma_rx, buf, false);
+    dma_channel_set_trans_count(bus_spi_dma_rx, size, false);
+    dma_channel_set_trans_count(bus_spi_dma_tx, size, false);
+    dma_start_channel_mask((1u << bus_spi_dma_tx) | (1u << bus_spi_dma_rx));
+    return true;
+}
+
+void bus_spi_dma_handler() {
+    uint32_t start = time_us_32();
+    dma_channel_acknowledge_irq0(bus_spi_dma_rx);
+    gpio_put(bus_spi_async_cs, true);
+    bus_spi_busy = false;
+    if (bus_spi_async_callback) bus_spi_async_callback();
+    bus_spi_irq_time += time_us_32() - start;
+}
+
+// Total time spent in the interrupt handler (including the callbacks), so the
+// CPU cost of the asynchronous reads can be measured.
+uint32_t bus_spi_get_irq_time() {
+    return bus_spi_irq_time;
+}
+
 uint8_t bus_spi_read_one(uint8_t cs, uint8_t reg) {
     uint8_t buf[1] = {0};
     bus_spi_read(cs, reg, buf, 1);
@@ -140,6 +197,25 @@ void bus_spi_init() {
     gpio_set_dir(PIN_SPI_CS1, GPIO_OUT);
     gpio_put(PIN_SPI_CS0, true);
     gpio_put(PIN_SPI_CS1, true);
+    // DMA channels for asynchronous reads, TX clocks out zeros while RX
+    // stores the incoming bytes.
+    bus_spi_dma_tx = dma_claim_unused_channel(true);
+    bus_spi_dma_rx = dma_claim_unused_channel(true);
+    dma_channel_config tx = dma_channel_get_default_config(bus_spi_dma_tx);
+    channel_config_set_transfer_data_size(&tx, DMA_SIZE_8);
+    channel_config_set_read_increment(&tx, false);
+    channel_config_set_write_increment(&tx, false);
+    channel_config_set_dreq(&tx, spi_get_dreq(spi1, true));
+    dma_channel_configure(bus_spi_dma_tx, &tx, &spi_get_hw(spi1)->dr, &bus_spi_zero, 0, false);
+    dma_channel_config rx = dma_channel_get_default_config(bus_spi_dma_rx);
+    channel_config_set_transfer_data_size(&rx, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx, false);
+    channel_config_set_write_increment(&rx, true);
+    channel_config_set_dreq(&rx, spi_get_dreq(spi1, false));
+    dma_channel_configure(bus_spi_dma_rx, &rx, NULL, &spi_get_hw(spi1)->dr, 0, false);
+    dma_channel_set_irq0_enabled(bus_spi_dma_rx, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, bus_spi_dma_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
 }
 
 void bus_init() {
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Sensors calibration.
+
+The thumbstick ADC and both IMUs (gyro and accelerometer in one transaction)
+are sampled interleaved in the same loop, so all of them are calibrated in the
+time the slowest one needs, instead of one after the other.
+
+Every channel keeps a running mean and variance (Welford's algorithm, stable in
+single precision). The loop runs faster than the output data rate of the IMUs,
+so their values are only added when the status register flags them as new,
+and the thumbstick is read with single conversions (not oversampled), so every
+sample counts as independent. Every CFG_CALIBRATION_CHECK_FREQ reads the 95%
+confidence interval of each mean is checked, and the calibration stops as soon
+as all of them are within the targets (after a minimum number of reads). If
+the variance shows that the controller was moved, the run is discarded and
+started again, up to CFG_CALIBRATION_ATTEMPTS times, keeping the previous
+offsets if none succeeds.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <pico/stdlib.h>
+#include "calibration.h"
+#include "config.h"
+#include "common.h"
+#include "imu.h"
+#include "led.h"
+#include "pin.h"
+#include "thumbstick.h"
+#include "vector.h"
+#include "logging.h"
+
+CalibrationChannel calibration_channels[CALIBRATION_CHANNELS];
+
+void calibration_add(CalibrationChannel *channel, float value) {
+    // Relative to the first value, so the increments of the mean are not lost
+    // in the float precision of large values (eg: 1G in the accelerometer).
+    if (channel->count == 0) channel->reference = value;
+    value -= channel->reference;
+    channel->count++;
+    float delta = value - channel->mean;
+    channel->mean += delta / channel->count;
+    channel->m2 += delta * (value - channel->mean);
+}
+
+float calibration_variance(CalibrationChannel *channel) {
+    if (channel->count < 2) return 0;
+    return channel->m2 / (channel->count - 1);
+}
+
+// Half width of the 95% confidence interval of the mean.
+float calibration_error(CalibrationChannel *channel) {
+    if (channel->count < 2) return INFINITY;
+    return 1.96f * sqrtf(calibration_variance(channel) / channel->count);
+}
+
+static void calibration_add_vector(CalibrationIndex index, Vector v) {
+    calibration_add(&calibration_channels[index + 0], v.x);
+    calibration_add(&calibration_channels[index + 1], v.y);
+    calibration_add(&calibration_channels[index + 2], v.z);
+}
+
+static void calibration_sample() {
+    Vector gyro;
+    Vector accel;
+    // Single conversions, see thumbstick_adc_free_running.
+    float x = thumbstick_adc_normalize(thumbstick_adc_single(1), 0.0);
+    float y = thumbstick_adc_normalize(thumbstick_adc_single(0), 0.0);
+    calibration_add(&calibration_channels[CALIBRATION_THUMBSTICK_X], x);
+    calibration_add(&calibration_channels[CALIBRATION_THUMBSTICK_Y], y);
+    // IMU values are only added when new, otherwise the repeated values would
+    // be counted as independent samples.
+    uint8_t ready = imu_read_raw(PIN_SPI_CS0, &gyro, &accel);
+    if (ready & IMU_STATUS_GDA) calibration_add_vector(CALIBRATION_GYRO_0_X, gyro);
+    if (ready & IMU_STATUS_XLDA) calibration_add_vector(CALIBRATION_ACCEL_0_X, accel);
+    ready = imu_read_raw(PIN_SPI_CS1, &gyro, &accel);
+    if (ready & IMU_STATUS_GDA) calibration_add_vector(CALIBRATION_GYRO_1_X, gyro);
+    if (ready & IMU_STATUS_XLDA) calibration_add_vector(CALIBRATION_ACCEL_1_X, accel);
+}
+
+// Largest error (or variance) of a range of channels.
+static float calibration_max(CalibrationIndex start, uint8_t len, bool variance) {
+    float result = 0;
+    for(uint8_t i=start; i<start+len; i++) {
+        CalibrationChannel *channel = &calibration_channels[i];
+        float value = variance ? calibration_variance(channel) : calibration_error(channel);
+        result = max(result, value);
+    }
+    return result;
+}
+
+static bool calibration_moved() {
+    return (
+        calibration_max(CALIBRATION_GYRO_1_X, 3, true) > CFG_CALIBRATION_MOTION_GYRO ||
+        calibration_max(CALIBRATION_ACCEL_0_X, 6, true) > CFG_CALIBRATION_MOTION_ACCEL
+    );
+}
+
+static bool calibration_precise() {
+    return (
+        calibration_max(CALIBRATION_THUMBSTICK_X, 2, false) < CFG_CALIBRATION_ERROR_THUMBSTICK &&
+        calibration_max(CALIBRATION_GYRO_0_X, 6, false) < CFG_CALIBRATION_ERROR_GYRO &&
+        calibration_max(CALIBRATION_ACCEL_0_X, 6, false) < CFG_CALIBRATION_ERROR_ACCEL
+    );
+}
+
+// Returns false if motion was detected.
+static bool calibration_attempt() {
+    memset(calibration_channels, 0, sizeof(calibration_channels));
+    for(uint32_t i=1; i<=CFG_CALIBRATION_SAMPLES_MAX; i++) {
+        if (!(i % CFG_CALIBRATION_BLINK_FREQ)) led_show_cycle_step();
+        calibration_sample();
+        if (i % CFG_CALIBRATION_CHECK_FREQ) continue;
+        if (calibration_moved()) return false;
+        if (i >= CFG_CALIBRATION_SAMPLES_MIN && calibration_precise()) return true;
+    }
+    return !calibration_moved();
+}
+
+float calibration_mean(CalibrationChannel *channel) {
+    return channel->reference + channel->mean;
+}
+
+static void calibration_apply() {
+    CalibrationChannel *channels = calibration_channels;
+    config_set_thumbstick_offset(
+        calibration_mean(&channels[CALIBRATION_THUMBSTICK_X]),
+        calibration_mean(&channels[CALIBRATION_THUMBSTICK_Y])
+    );
+    config_set_gyro_offset(
+        calibration_mean(&channels[CALIBRATION_GYRO_0_X]),
+        calibration_mean(&channels[CALIBRATION_GYRO_0_Y]),
+        calibration_mean(&channels[CALIBRATION_GYRO_0_Z]),
+        calibration_mean(&channels[CALIBRATION_GYRO_1_X]),
+        calibration_mean(&channels[CALIBRATION_GYRO_1_Y]),
+        calibration_mean(&channels[CALIBRATION_GYRO_1_Z])
+    );
+    // Assuming the resting state of the controller is having a vector of 1G
+    // pointing down. (Newton's fault for inventing the gravity /jk).
+    config_set_accel_offset(
+        calibration_mean(&channels[CALIBRATION_ACCEL_0_X]),
+        calibration_mean(&channels[CALIBRATION_ACCEL_0_Y]),
+        calibration_mean(&channels[CALIBRATION_ACCEL_0_Z]) - BIT_14,
+        calibration_mean(&channels[CALIBRATION_ACCEL_1_X]),
+        calibration_mean(&channels[CALIBRATION_ACCEL_1_Y]),
+        calibration_mean(&channels[CALIBRATION_ACCEL_1_Z]) - BIT_14
+    );
+    thumbstick_update_offsets();
+    imu_update_offsets();
+    imu_bias_reset();
+}
+
+static void calibration_report(uint32_t elapsed) {
+    CalibrationChannel *channels = calibration_channels;
+    info("Calibration: %lu reads (%lu gyro samples) in %lu ms\n",
+        channels[CALIBRATION_THUMBSTICK_X].count,
+        channels[CALIBRATION_GYRO_0_X].count,
+        elapsed
+    );
+    info("  thumbstick x=%.4f y=%.4f (+-%.5f)\n",
+        calibration_mean(&channels[CALIBRATION_THUMBSTICK_X]),
+        calibration_mean(&channels[CALIBRATION_THUMBSTICK_Y]),
+        calibration_max(CALIBRATION_THUMBSTICK_X, 2, false)
+    );
+    for(uint8_t i=CALIBRATION_GYRO_0_X; i<CALIBRATION_CHANNELS; i+=3) {
+        char *name = i < CALIBRATION_ACCEL_0_X ? "gyro" : "accel";
+        uint8_t imu = ((i - CALIBRATION_GYRO_0_X) / 3) % 2;
+        info("  %-5s %i x=%8.2f y=%8.2f z=%8.2f (+-%.2f)\n",
+            name,
+            imu,
+            calibration_mean(&channels[i+0]),
+            calibration_mean(&channels[i+1]),
+            calibration_mean(&channels[i+2]),
+            calibration_max(i, 3, false)
+        );
+    }
+}
+
+bool calibration_run() {
+    thumbstick_adc_free_running(false);
+    bool still = false;
+    for(uint8_t attempt=0; attempt<CFG_CALIBRATION_ATTEMPTS; attempt++) {
+        uint32_t start = to_ms_since_boot(get_absolute_time());
+        still = calibration_attempt();
+        uint32_t elapsed = to_ms_since_boot(get_absolute_time()) - start;
+        calibration_report(elapsed);
+        if (still) break;
+        warn("Calibration: motion detected, restarting\n");
+    }
+    thumbstick_adc_free_running(true);
+    if (!still) {
+        warn("Calibration: failed, previous offsets are kept\n");
+        return false;
+    }
+    calibration_apply();
+    return true;
+}
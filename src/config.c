@@ -9,6 +9,7 @@
 #include <pico/bootrom.h>
 #include <pico/unique_id.h>
 #include "config.h"
+#include "calibration.h"
 #include "nvm.h"
 #include "led.h"
 #include "hid.h"
@@ -16,6 +17,7 @@
 #include "thumbstick.h"
 #include "touch.h"
 #include "profile.h"
+#include "sampler.h"
 #include "webusb.h"
 #include "common.h"
 #include "logging.h"
@@ -301,12 +303,14 @@ void config_factory() {
     config_reboot();
 }
 
-void config_calibrate_execute() {
+bool config_calibrate_execute() {
     led_set_mode(LED_MODE_CYCLE);
-    thumbstick_calibrate();
-    imu_calibrate();
+    sampler_pause();  // Calibration needs raw access to the sensors.
+    bool success = calibration_run();
+    sampler_resume();
     profile_led_lock = false;
     led_set_mode(LED_MODE_IDLE);
+    return success;
 }
 
 void config_calibrate() {
@@ -321,10 +325,11 @@ void config_calibrate() {
         sleep_ms(1000);
     }
     info("\n");
-    config_calibrate_execute();
-    config_set_problem_calibration(false);
+    if (config_calibrate_execute()) {
+        config_set_problem_calibration(false);
+        info("Calibration completed\n");
+    }
     led_set_mode(LED_MODE_IDLE);
-    info("Calibration completed\n");
     logging_set_onloop(true);
 }
 
@@ -5,6 +5,7 @@
 #include "ctrl.h"
 #include "thumbstick.h"
 #include "config.h"
+#include "profiler.h"
 #include "common.h"
 
 Ctrl ctrl_log(uint8_t* offset_ptr, uint8_t len) {
@@ -74,3 +75,31 @@ Ctrl ctrl_profile_share(uint8_t profile_index, uint8_t section_index) {
     }
     return ctrl;
 }
+
+Ctrl ctrl_stats_share(uint8_t stage) {
+    Ctrl ctrl = {
+        .protocol_version = CTRL_PROTOCOL_VERSION,
+        .device_id = ALPAKKA,
+        .message_type = STATS_SHARE,
+        .len = 17
+    };
+    ProfilerSummary summary = profiler_summary(stage);
+    uint16_t values[] = {
+        summary.min,
+        summary.max,
+        summary.avg,
+        summary.p50,
+        summary.p90,
+        summary.p99,
+    };
+    // Write payload (multi-byte values as little endian).
+    ctrl.payload[0] = stage;
+    for(uint8_t i=0; i<4; i++) {
+        ctrl.payload[1+i] = (summary.count >> (i*8)) & BIT_8;
+    }
+    for(uint8_t i=0; i<6; i++) {
+        ctrl.payload[5+(i*2)] = values[i] & BIT_8;
+        ctrl.payload[6+(i*2)] = values[i] >> 8;
+    }
+    return ctrl;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Input events from interrupt handlers.
+
+Interrupt handlers (eg: the rotary GPIO interrupt) do not modify any state
+themselves, they push a timestamped event into a ring, which is drained by the
+main loop at a single point of the tick (event_drain), applying the events in
+the order they happened. So profile state is never modified while the main
+loop is reading it, and the latency of every event is measured.
+
+The ring is single-producer single-consumer, multiple interrupt handlers (that
+may preempt each other) are serialized by disabling interrupts just for the
+duration of the push, which is a handful of instructions. The RP2040 has no
+exclusive access instructions to do it otherwise.
+*/
+
+#include <pico/stdlib.h>
+#include <hardware/sync.h>
+#include "event.h"
+#include "ring.h"
+#include "profile.h"
+#include "profiler.h"
+#include "logging.h"
+
+Event event_buffer[EVENT_RING_SLOTS];
+Ring event_ring;
+
+void event_init() {
+    event_ring = Ring_(event_buffer, sizeof(Event), EVENT_RING_SLOTS);
+}
+
+// Safe to be called from interrupt handlers (core 0).
+bool event_push(EventType type, int8_t value) {
+    Event event = {
+        .timestamp = time_us_32(),
+        .type = type,
+        .value = value,
+    };
+    uint32_t interrupts = save_and_disable_interrupts();
+    bool pushed = ring_push(&event_ring, &event);
+    restore_interrupts(interrupts);
+    return pushed;
+}
+
+void event_drain() {
+    Event event;
+    while(ring_pop(&event_ring, &event)) {
+        profiler_record(STAGE_EVENT_LATENCY, time_us_32() - event.timestamp);
+        if (event.type == EVENT_ROTARY) rotary_event(event.value, event.timestamp);
+    }
+}
+
+void event_log_stats() {
+    if (event_ring.dropped) debug("Events: dropped=%lu\n", event_ring.dropped);
+}
@@ -2,6 +2,7 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include "button.h"
@@ -12,28 +13,82 @@
 #include "imu.h"
 #include "led.h"
 #include "pin.h"
+#include "sampler.h"
 #include "touch.h"
 #include "vector.h"
 
-double sensitivity_multiplier;
-double antideadzone = 0; // TODO: Experimental.
+float sensitivity_multiplier;
+float sensitivity_x;  // Gyro bits to pixels, 16.16 fixed point.
+float sensitivity_y;
+float sensitivity_z;
+float antideadzone = 0; // TODO: Experimental.
 
 uint8_t world_init = 0;
 Vector world_top;
 Vector world_fw;
 Vector world_right;
 Vector accel_smooth;
+Vector4 orientation = {0, 0, 0, 1};  // Rotates the controller axes into the world axes.
+Vector orientation_integral;  // Mahony integral feedback (radians per second).
 
 void gyro_update_sensitivity() {
     uint8_t preset = config_get_mouse_sens_preset();
     sensitivity_multiplier = config_get_mouse_sens_value(preset);
+    sensitivity_x = CFG_GYRO_SENSITIVITY_X * sensitivity_multiplier * 65536;
+    sensitivity_y = CFG_GYRO_SENSITIVITY_Y * sensitivity_multiplier * 65536;
+    sensitivity_z = CFG_GYRO_SENSITIVITY_Z * sensitivity_multiplier * 65536;
+}
+
+// Default curve gains, sampled from the former hssnf(t=1, k=0.5) curve.
+const uint8_t gyro_curve_default[GYRO_CURVE_POINTS] = {50, 57, 67, 80, 100, 100, 100, 100};
+
+// Build the lookup table of a response curve (at profile load).
+void gyro_curve_compile(GyroCurve *curve, uint8_t *points) {
+    bool empty = true;
+    for(uint8_t i=0; i<GYRO_CURVE_POINTS; i++) {
+        if (points[i]) empty = false;
+    }
+    const uint8_t *gains = empty ? gyro_curve_default : points;
+    for(uint8_t i=0; i<=GYRO_CURVE_LUT; i++) {
+        float input = (float)(i << GYRO_CURVE_SHIFT) / 65536;
+        float position = input / GYRO_CURVE_STEP;
+        uint8_t index = position;
+        float gain;
+        if (index >= GYRO_CURVE_POINTS - 1) {
+            gain = gains[GYRO_CURVE_POINTS - 1];
+        } else {
+            float frac = position - index;
+            gain = gains[index] + ((gains[index+1] - gains[index]) * frac);
+        }
+        curve->lut[i] = (input * gain / 100 * 65536) + 0.5f;
+    }
+    curve->gain = ((gains[GYRO_CURVE_POINTS - 1] * 65536) + 50) / 100;
+    // The end of the table with the same gain used beyond it, so the curve is
+    // continuous (and monotonic) across.
+    curve->lut[GYRO_CURVE_LUT] = ((int64_t)GYRO_CURVE_RANGE * curve->gain) >> 16;
+}
+
+// Response curve of a 16.16 fixed point value, interpolated from the table.
+int32_t gyro_curve(GyroCurve *curve, int32_t value) {
+    int32_t input = abs(value);
+    int32_t output;
+    if (input >= GYRO_CURVE_RANGE) {
+        output = ((int64_t)input * curve->gain) >> 16;
+    } else {
+        uint8_t i = input >> GYRO_CURVE_SHIFT;
+        int32_t frac = input & ((1 << GYRO_CURVE_SHIFT) - 1);
+        int32_t a = curve->lut[i];
+        int32_t b = curve->lut[i+1];
+        output = a + (((b - a) * frac) >> GYRO_CURVE_SHIFT);
+    }
+    return value < 0 ? -output : output;
 }
 
 // TODO: Experimental.
 void gyro_wheel_antideadzone(int8_t increment) {
-    if (increment > 0) antideadzone += 0.01;
-    else antideadzone -= 0.01;
-    antideadzone = constrain(antideadzone, 0, 0.50);
+    if (increment > 0) antideadzone += 0.01f;
+    else antideadzone -= 0.01f;
+    antideadzone = constrain(antideadzone, 0, 0.50f);
     printf("antideadzone=%f\n", antideadzone);
     uint8_t adz = (antideadzone * 100) + 0.001;
     led_static_mask(LED_NONE);
@@ -49,50 +104,105 @@ void gyro_wheel_antideadzone(int8_t increment) {
     else if (adz==10 || adz==20 || adz==30) led_blink_mask(0b0111);
 }
 
-void gyro_accel_correction() {
-    Vector accel = imu_read_accel();
-    // Convert to inverted unit value.
-    accel.x /= -BIT_14;
-    accel.y /= -BIT_14;
-    accel.z /= -BIT_14;
-    // Get a smoothed gravity vector.
+void gyro_orientation_reset() {
+    world_init = 0;
+    accel_smooth = (Vector){0, 0, 0};
+    orientation_integral = (Vector){0, 0, 0};
+}
+
+// World axes (in controller space) from the orientation quaternion, these are
+// the columns of its rotation matrix.
+void gyro_orientation_axes() {
+    Vector4 q = orientation;
+    world_right = (Vector){
+        1 - 2 * (q.y*q.y + q.z*q.z),
+        2 * (q.x*q.y + q.r*q.z),
+        2 * (q.x*q.z - q.r*q.y)
+    };
+    world_fw = (Vector){
+        2 * (q.x*q.y - q.r*q.z),
+        1 - 2 * (q.x*q.x + q.z*q.z),
+        2 * (q.y*q.z + q.r*q.x)
+    };
+    world_top = (Vector){
+        2 * (q.x*q.z + q.r*q.y),
+        2 * (q.y*q.z - q.r*q.x),
+        1 - 2 * (q.x*q.x + q.y*q.y)
+    };
+}
+
+// Initial orientation from the averaged gravity vector, with the forward axis
+// perpendicular to the controller X axis (or the right axis perpendicular to
+// the controller Y axis, if X is close to vertical). Returns false while
+// averaging.
+bool gyro_orientation_init(Vector accel) {
     accel_smooth = vector_smooth(accel_smooth, accel, CFG_ACCEL_CORRECTION_SMOOTH);
-    if (world_init < CFG_ACCEL_CORRECTION_SMOOTH) {
-        // It the world space orientation is not fully initialized.
-        world_top = vector_normalize(vector_invert(accel_smooth));
-        world_fw = vector_cross_product(world_top, (Vector){1, 0, 0});
+    if (vector_lenght(accel_smooth) == 0) return false;
+    world_top = vector_normalize(accel_smooth);
+    Vector fw = vector_cross_product(world_top, (Vector){1, 0, 0});
+    if (vector_lenght(fw) > 0.1f) {
+        world_fw = vector_normalize(fw);
         world_right = vector_cross_product(world_fw, world_top);
-        world_init++;
     } else {
-        // Correction.
-        float rate_fw = (world_right.z - accel_smooth.x) * CFG_ACCEL_CORRECTION_RATE;
-        float rate_r = (world_fw.z - accel_smooth.y) * CFG_ACCEL_CORRECTION_RATE;
-        Vector4 correction_fw = quaternion(world_fw, rate_fw);
-        Vector4 correction_r = quaternion(world_right, -rate_r);
-        Vector4 correction = qmultiply(correction_fw, correction_r);
-        world_top = qrotate(correction, world_top);
-        world_right = qrotate(correction, world_right);
+        world_right = vector_normalize(vector_cross_product((Vector){0, 1, 0}, world_top));
         world_fw = vector_cross_product(world_top, world_right);
     }
+    orientation = qbasis(world_right, world_fw, world_top);
+    world_init++;
+    return world_init >= CFG_ACCEL_CORRECTION_SMOOTH;
+}
+
+// Mahony complementary filter step. The gyro rotation over DT microseconds is
+// integrated into a single quaternion, while the error between the estimated
+// and the measured gravity is fed back as an extra rotation (proportional and
+// integral terms), so the tilt does not drift and the gyro bias is absorbed.
+// The integral (the bias estimate) keeps being applied while the controller
+// is accelerated, only its update is skipped.
+void gyro_orientation_update(Vector gyro, Vector accel, uint32_t dt) {
+    // Rotation in controller axes, see imu_decode_gyro for the axes order
+    // (sensitivity tuned for 250Hz).
+    float sens = ((float)dt / CFG_GYRO_DT_REFERENCE) / (-BIT_18 * (float)M_PI);
+    Vector theta = {gyro.y * sens, gyro.z * sens, gyro.x * sens};
+    // Gravity feedback, skipped if the controller is being accelerated.
+    float seconds = dt / 1000000.0f;
+    float norm = vector_lenght(accel) / BIT_14;
+    if (fabsf(norm - 1) < CFG_GYRO_MAHONY_ACCEL_RANGE) {
+        Vector error = vector_cross_product(world_top, vector_normalize(accel));
+        float ki = CFG_GYRO_MAHONY_KI * seconds;
+        orientation_integral.x += error.x * ki;
+        orientation_integral.y += error.y * ki;
+        orientation_integral.z += error.z * ki;
+        float kp = CFG_GYRO_MAHONY_KP * seconds;
+        theta.x += error.x * kp;
+        theta.y += error.y * kp;
+        theta.z += error.z * kp;
+    }
+    theta.x += orientation_integral.x * seconds;
+    theta.y += orientation_integral.y * seconds;
+    theta.z += orientation_integral.z * seconds;
+    // Small angle rotation, no trigonometry needed.
+    Vector4 r = {theta.x / 2, theta.y / 2, theta.z / 2, 1};
+    orientation = qnormalize(qmultiply(r, orientation));
+    gyro_orientation_axes();
 }
 
 void gyro_absolute_output(float value, uint8_t *actions, bool *pressed) {
     for(uint8_t i=0; i<4; i++) {
         uint8_t action = actions[i];
         if (hid_is_axis(action)) {
-            value = fabs(value);
-            if      (action == GAMEPAD_AXIS_LX)     hid_gamepad_lx( value);
-            else if (action == GAMEPAD_AXIS_LY)     hid_gamepad_ly( value);
-            else if (action == GAMEPAD_AXIS_LZ)     hid_gamepad_lz( value);
-            else if (action == GAMEPAD_AXIS_RX)     hid_gamepad_rx( value);
-            else if (action == GAMEPAD_AXIS_RY)     hid_gamepad_ry( value);
-            else if (action == GAMEPAD_AXIS_RZ)     hid_gamepad_rz( value);
-            else if (action == GAMEPAD_AXIS_LX_NEG) hid_gamepad_lx(-value);
-            else if (action == GAMEPAD_AXIS_LY_NEG) hid_gamepad_ly(-value);
-            else if (action == GAMEPAD_AXIS_LZ_NEG) hid_gamepad_lz(-value);
-            else if (action == GAMEPAD_AXIS_RX_NEG) hid_gamepad_rx(-value);
-            else if (action == GAMEPAD_AXIS_RY_NEG) hid_gamepad_ry(-value);
-            else if (action == GAMEPAD_AXIS_RZ_NEG) hid_gamepad_rz(-value);
+            Axis axis = axis_from_float(fabsf(value));
+            if      (action == GAMEPAD_AXIS_LX)     hid_gamepad_lx( axis);
+            else if (action == GAMEPAD_AXIS_LY)     hid_gamepad_ly( axis);
+            else if (action == GAMEPAD_AXIS_LZ)     hid_gamepad_lz( axis);
+            else if (action == GAMEPAD_AXIS_RX)     hid_gamepad_rx( axis);
+            else if (action == GAMEPAD_AXIS_RY)     hid_gamepad_ry( axis);
+            else if (action == GAMEPAD_AXIS_RZ)     hid_gamepad_rz( axis);
+            else if (action == GAMEPAD_AXIS_LX_NEG) hid_gamepad_lx(-axis);
+            else if (action == GAMEPAD_AXIS_LY_NEG) hid_gamepad_ly(-axis);
+            else if (action == GAMEPAD_AXIS_LZ_NEG) hid_gamepad_lz(-axis);
+            else if (action == GAMEPAD_AXIS_RX_NEG) hid_gamepad_rx(-axis);
+            else if (action == GAMEPAD_AXIS_RY_NEG) hid_gamepad_ry(-axis);
+            else if (action == GAMEPAD_AXIS_RZ_NEG) hid_gamepad_rz(-axis);
         } else {
             if (!(*pressed) && value >= 0.5) {
                 hid_press(action);
@@ -106,7 +216,7 @@ void gyro_absolute_output(float value, uint8_t *actions, bool *pressed) {
     }
 }
 
-void gyro_incremental_output(double value, uint8_t *actions) {
+void gyro_incremental_output(int16_t value, uint8_t *actions) {
     for(uint8_t i=0; i<4; i++) {
         uint8_t action = actions[i];
         if      (action == MOUSE_X)     hid_mouse_move(value, 0);
@@ -116,50 +226,28 @@ void gyro_incremental_output(double value, uint8_t *actions) {
     }
 }
 
-double hssnf(double t, double k, double x) {
-    double a = x - (x * k);
-    double b = 1 - (x * k * (1/t));
-    return a / b;
-}
-
 void Gyro__report_absolute(Gyro *self) {
-    // Accel-based correction.
-    gyro_accel_correction();
-    // Get data from gyros.
-    Vector gyro = imu_read_gyro();
-    static float sens = -BIT_18 * M_PI;
-    // Rotate world space orientation.
-    Vector4 rx = quaternion(world_right, gyro.y / sens);
-    Vector4 ry = quaternion(world_fw, gyro.z / sens);
-    Vector4 rz = quaternion(world_top, gyro.x / sens);
-    static uint8_t i = 0;
-    Vector4 r;
-    if      (i==0) r = qmultiply(qmultiply(rx, ry), rz);
-    else if (i==1) r = qmultiply(qmultiply(rz, rx), ry);
-    else if (i==2) r = qmultiply(qmultiply(ry, rz), rx);
-    else if (i==3) r = qmultiply(qmultiply(rx, rz), ry);
-    else if (i==4) r = qmultiply(qmultiply(ry, rx), rz);
-    else if (i==5) r = qmultiply(qmultiply(rz, ry), rx);
-    i++;
-    if (i>5) i = 0;
-    world_top = qrotate(r, world_top);
-    world_fw = qrotate(r, world_fw);
-    world_right = vector_cross_product(world_fw, world_top);
+    // Gyro and accel from the same acquisition.
+    ImuSample imu = sampler_read_imu();
+    // World space orientation.
+    if (world_init < CFG_ACCEL_CORRECTION_SMOOTH) gyro_orientation_init(imu.accel);
+    else gyro_orientation_update(imu.gyro, imu.accel, imu.dt);
     // Debug.
     bool debug = 0;
     if (debug) {
-        hid_gamepad_lx(world_top.x);
-        hid_gamepad_ly(-world_top.y);
-        hid_gamepad_rx(world_fw.x);
-        hid_gamepad_ry(-world_fw.y);
+        hid_gamepad_lx(axis_from_float(world_top.x));
+        hid_gamepad_ly(axis_from_float(-world_top.y));
+        hid_gamepad_rx(axis_from_float(world_fw.x));
+        hid_gamepad_ry(axis_from_float(-world_fw.y));
         return;
     }
     // Output calculation.
-    float x = degrees(asin(-world_right.z)) / 90;
-    float y = degrees(asin(-world_top.z)) / 90;
-    float z = degrees(asin(world_fw.z)) / 90;
-    if (fabs(x) > 0.5 && z < 0) x += -z * 2 * sign(x); // Steering lock.
-    x = constrain(x * 1.1, -1, 1); // Additional saturation.
+    // Unit value from [-90,90] degrees.
+    float x = asinf(-world_right.z) * (float)(2 / M_PI);
+    float y = asinf(-world_top.z) * (float)(2 / M_PI);
+    float z = asinf(world_fw.z) * (float)(2 / M_PI);
+    if (fabsf(x) > 0.5f && z < 0) x += -z * 2 * sign(x); // Steering lock.
+    x = constrain(x * 1.1f, -1, 1); // Additional saturation.
     x = x > 0 ? ramp_inv(x, antideadzone) : -ramp_inv(-x, antideadzone); // Deadzone.
     x = ramp(x, self->absolute_x_min/90, self->absolute_x_max/90); // Adjust range.
     y = ramp(y, self->absolute_y_min/90, self->absolute_y_max/90); // Adjust range.
@@ -172,38 +260,43 @@ void Gyro__report_absolute(Gyro *self) {
 }
 
 void Gyro__report_incremental(Gyro *self) {
-    static double sub_x = 0;
-    static double sub_y = 0;
-    static double sub_z = 0;
+    // Subpixel leftovers, 16.16 fixed point.
+    static int32_t sub_x = 0;
+    static int32_t sub_y = 0;
+    static int32_t sub_z = 0;
      // Read gyro values.
-    Vector imu_gyro = imu_read_gyro();
-    double x = imu_gyro.x * CFG_GYRO_SENSITIVITY_X * sensitivity_multiplier;
-    double y = imu_gyro.y * CFG_GYRO_SENSITIVITY_Y * sensitivity_multiplier;
-    double z = imu_gyro.z * CFG_GYRO_SENSITIVITY_Z * sensitivity_multiplier;
-    // Additional processing.
-    double t = 1.0;
-    double k = 0.5;
-    if      (x > 0 && x <  t) x =  hssnf(t, k,  x);
-    else if (x < 0 && x > -t) x = -hssnf(t, k, -x);
-    if      (y > 0 && y <  t) y =  hssnf(t, k,  y);
-    else if (y < 0 && y > -t) y = -hssnf(t, k, -y);
-    if      (z > 0 && z <  t) z =  hssnf(t, k,  z);
-    else if (z < 0 && z > -t) z = -hssnf(t, k, -z);
+    ImuSample imu = sampler_read_imu();
+    Vector imu_gyro = imu.gyro;
+    int32_t x = imu_gyro.x * sensitivity_x;
+    int32_t y = imu_gyro.y * sensitivity_y;
+    int32_t z = imu_gyro.z * sensitivity_z;
+    // Response curve (tuned for 250Hz deltas).
+    x = gyro_curve(&(self->curve_x), x);
+    y = gyro_curve(&(self->curve_y), y);
+    z = gyro_curve(&(self->curve_z), z);
+    // Scale the 250Hz delta to the time actually elapsed.
+    int32_t scale = (imu.dt << 16) / CFG_GYRO_DT_REFERENCE;
+    x = ((int64_t)x * scale) >> 16;
+    y = ((int64_t)y * scale) >> 16;
+    z = ((int64_t)z * scale) >> 16;
     // Reintroduce subpixel leftovers.
     x += sub_x;
     y += sub_y;
     z += sub_z;
-    // Round down and save leftovers.
-    sub_x = modf(x, &x);
-    sub_y = modf(y, &y);
-    sub_z = modf(z, &z);
+    // Round towards zero and save leftovers.
+    int16_t px_x = x / 65536;
+    int16_t px_y = y / 65536;
+    int16_t px_z = z / 65536;
+    sub_x = x - (px_x * 65536);
+    sub_y = y - (px_y * 65536);
+    sub_z = z - (px_z * 65536);
     // Report.
-    if (x >= 0) gyro_incremental_output( x, self->actions_x_pos);
-    else        gyro_incremental_output(-x, self->actions_x_neg);
-    if (y >= 0) gyro_incremental_output( y, self->actions_y_pos);
-    else        gyro_incremental_output(-y, self->actions_y_neg);
-    if (z >= 0) gyro_incremental_output( z, self->actions_z_pos);
-    else        gyro_incremental_output(-z, self->actions_z_neg);
+    if (px_x >= 0) gyro_incremental_output( px_x, self->actions_x_pos);
+    else           gyro_incremental_output(-px_x, self->actions_x_neg);
+    if (px_y >= 0) gyro_incremental_output( px_y, self->actions_y_pos);
+    else           gyro_incremental_output(-px_y, self->actions_y_neg);
+    if (px_z >= 0) gyro_incremental_output( px_z, self->actions_z_pos);
+    else           gyro_incremental_output(-px_z, self->actions_z_neg);
 }
 
 bool Gyro__is_engaged(Gyro *self) {
@@ -228,7 +321,7 @@ void Gyro__report(Gyro *self) {
 }
 
 void Gyro__reset(Gyro *self) {
-    world_init = 0;
+    gyro_orientation_reset();
     self->pressed_x_pos = false;
     self->pressed_y_pos = false;
     self->pressed_z_pos = false;
@@ -237,25 +330,28 @@ void Gyro__reset(Gyro *self) {
     self->pressed_z_neg = false;
 }
 
-void Gyro__config_x(Gyro *self, double min, double max, Actions neg, Actions pos) {
+void Gyro__config_x(Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve) {
     self->absolute_x_min = min;
     self->absolute_x_max = max;
     memcpy(self->actions_x_neg, neg, ACTIONS_LEN);
     memcpy(self->actions_x_pos, pos, ACTIONS_LEN);
+    gyro_curve_compile(&(self->curve_x), curve);
 }
 
-void Gyro__config_y(Gyro *self, double min, double max, Actions neg, Actions pos) {
+void Gyro__config_y(Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve) {
     self->absolute_y_min = min;
     self->absolute_y_max = max;
     memcpy(self->actions_y_neg, neg, ACTIONS_LEN);
     memcpy(self->actions_y_pos, pos, ACTIONS_LEN);
+    gyro_curve_compile(&(self->curve_y), curve);
 }
 
-void Gyro__config_z(Gyro *self, double min, double max, Actions neg, Actions pos) {
+void Gyro__config_z(Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve) {
     self->absolute_z_min = min;
     self->absolute_z_max = max;
     memcpy(self->actions_z_neg, neg, ACTIONS_LEN);
     memcpy(self->actions_z_pos, pos, ACTIONS_LEN);
+    gyro_curve_compile(&(self->curve_z), curve);
 }
 
 Gyro Gyro_ (
@@ -283,6 +379,10 @@ Gyro Gyro_ (
     memset(gyro.actions_x_neg, 0, ACTIONS_LEN);
     memset(gyro.actions_y_neg, 0, ACTIONS_LEN);
     memset(gyro.actions_z_neg, 0, ACTIONS_LEN);
+    uint8_t curve[GYRO_CURVE_POINTS] = {0,};
+    gyro_curve_compile(&(gyro.curve_x), curve);
+    gyro_curve_compile(&(gyro.curve_y), curve);
+    gyro_curve_compile(&(gyro.curve_z), curve);
     gyro_update_sensitivity();
     gyro.reset(&gyro);
     return gyro;
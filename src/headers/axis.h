@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+
+// Analog axis as Q15 fixed point unit value, from -1 (-32767) to 1 (32767).
+// The range is kept symmetric so negation never overflows.
+typedef int16_t Axis;
+
+#define AXIS_MAX 32767
+#define AXIS_MIN -32767
+#define AXIS_TRIGGER_MAX 255
+
+Axis axis_from_float(float value);
+float axis_to_float(Axis value);
+Axis axis_saturate(int32_t value);
+Axis axis_add(Axis a, Axis b);
+Axis axis_neg(Axis value);
+Axis axis_abs(Axis value);
+Axis axis_mul(Axis a, Axis b);
+Axis axis_ramp_low(Axis value, Axis k);
+Axis axis_ramp_mid(Axis value, Axis k);
+int16_t axis_to_trigger_signed(Axis value);
+uint8_t axis_to_trigger(Axis value);
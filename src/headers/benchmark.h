@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+
+#define BENCHMARK_TICKS 2000  // Ticks measured per profile.
+#define BENCHMARK_IMU_TICKS 500  // Reads measured per IMU read path.
+#define BENCHMARK_VECTOR_CALLS 1000  // Calls measured per vector function.
+#define BENCHMARK_FILTER_TICKS 1000  // Ticks replayed at rest, and then flicked.
+#define BENCHMARK_FILTER_NOISE 0.005f  // Peak ADC noise at rest (unit value).
+#define BENCHMARK_FILTER_CUTOFF 5.0f  // Hz, replayed filter parameters.
+#define BENCHMARK_FILTER_BETA 5.0f
+
+void benchmark();
@@ -37,6 +37,17 @@ void bus_i2c_io_cache_update();
 bool bus_i2c_io_cache_read(uint8_t device_index, uint8_t bit_index);
 bool bus_i2c_io_read(uint8_t device_id, uint8_t bit_index);
 // SPI.
+typedef void (*BusSpiCallback)();
+
 void bus_spi_write(uint8_t cs, uint8_t reg, uint8_t value);
-void bus_spi_read(uint8_t cs, uint8_t reg, uint8_t *buf, uint8_t size);
+void bus_spi_read(uint8_t cs, uint8_t reg, uint8_t *buf, uint16_t size);
 uint8_t bus_spi_read_one(uint8_t cs, uint8_t reg);
+bool bus_spi_read_async(
+    uint8_t cs,
+    uint8_t reg,
+    uint8_t *buf,
+    uint16_t size,
+    BusSpiCallback callback
+);
+void bus_spi_wait();
+uint32_t bus_spi_get_irq_time();
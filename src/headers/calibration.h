@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Running mean and variance of one sensor channel (Welford's algorithm).
+typedef struct CalibrationChannel_struct {
+    uint32_t count;
+    float reference;  // First value, the mean is relative to it.
+    float mean;
+    float m2;  // Sum of squared differences from the mean.
+} CalibrationChannel;
+
+typedef enum CalibrationIndex_enum {
+    CALIBRATION_THUMBSTICK_X,
+    CALIBRATION_THUMBSTICK_Y,
+    CALIBRATION_GYRO_0_X,
+    CALIBRATION_GYRO_0_Y,
+    CALIBRATION_GYRO_0_Z,
+    CALIBRATION_GYRO_1_X,
+    CALIBRATION_GYRO_1_Y,
+    CALIBRATION_GYRO_1_Z,
+    CALIBRATION_ACCEL_0_X,
+    CALIBRATION_ACCEL_0_Y,
+    CALIBRATION_ACCEL_0_Z,
+    CALIBRATION_ACCEL_1_X,
+    CALIBRATION_ACCEL_1_Y,
+    CALIBRATION_ACCEL_1_Z,
+    CALIBRATION_CHANNELS,
+} CalibrationIndex;
+
+void calibration_add(CalibrationChannel *channel, float value);
+float calibration_mean(CalibrationChannel *channel);
+float calibration_variance(CalibrationChannel *channel);
+float calibration_error(CalibrationChannel *channel);
+bool calibration_run();
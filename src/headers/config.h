@@ -20,23 +20,56 @@
 
 #define CFG_LED_BRIGHTNESS 0.2
 
-#define CFG_TICK_FREQUENCY 250  // Hz.
+#define CFG_TICK_1KHZ false  // Tick at 1000Hz instead of 250Hz.
+#define CFG_TICK_FREQUENCY (CFG_TICK_1KHZ ? 1000 : 250)  // Hz.
 #define CFG_TICK_INTERVAL  (1000 / CFG_TICK_FREQUENCY)
-#define CFG_IMU_TICK_SAMPLES 128  // Multi-sampling per pooling cycle.
-#define CFG_HID_REPORT_PRIORITY_RATIO 8
-
-#define CFG_CALIBRATION_SAMPLES_THUMBSTICK 100000  // Samples.
-#define CFG_CALIBRATION_SAMPLES_GYRO 200000  // Samples.
-#define CFG_CALIBRATION_SAMPLES_ACCEL 100000  // Samples.
-#define CFG_CALIBRATION_BLINK_FREQ 50000  // Ticks.
-
-#define CFG_GYRO_SENSITIVITY  pow(2, -9) * 1.45
+#define CFG_TICK_SCALE  (250.0f / CFG_TICK_FREQUENCY)  // Per-tick values tuned at 250Hz.
+#define CFG_TICK_SOF_SYNC false  // Lock the tick phase to the USB start-of-frame.
+#define CFG_TICK_SOF_MARGIN 150  // Microseconds before the poll reports must be ready.
+#define CFG_IMU_TICK_SAMPLES (CFG_TICK_1KHZ ? 32 : 128)  // Multi-sampling per pooling cycle.
+#define CFG_IMU_FIFO false  // Drain the IMU hardware FIFO instead of multi-sampling.
+#define CFG_IMU_FIFO_WATERMARK (6667 / CFG_TICK_FREQUENCY)  // Gyro samples per tick.
+#define CFG_IMU_ASYNC false  // Read the IMU FIFOs with DMA, one tick ahead (single core).
+#define CFG_HID_REPORT_WEIGHT_KEYBOARD 16  // Scheduler share when reports compete.
+#define CFG_HID_REPORT_WEIGHT_MOUSE 8
+#define CFG_HID_REPORT_WEIGHT_GAMEPAD 1
+#define CFG_HID_REPORT_DEADLINE_KEYBOARD 2000  // Microseconds queued before forced.
+#define CFG_HID_REPORT_DEADLINE_MOUSE 2000
+#define CFG_HID_REPORT_DEADLINE_GAMEPAD 4000
+#define CFG_DUAL_CORE false  // Sensor acquisition on core 1.
+
+#define CFG_IMU_BIAS false  // Update the gyro offsets at runtime when the controller is still (writes NVM).
+#define CFG_IMU_BIAS_WINDOW 1000000  // Microseconds per stillness evaluation.
+#define CFG_IMU_BIAS_ACCEL_INTERVAL 32000  // Accel sampling when not read with the gyro (microseconds).
+#define CFG_IMU_BIAS_MIN_SAMPLES 100  // Gyro reads needed for a window to be evaluated.
+#define CFG_IMU_BIAS_GYRO_VARIANCE 400  // Max gyro variance to be still (high sensitivity IMU bits).
+#define CFG_IMU_BIAS_GYRO_MEAN 460  // Max gyro residual to be still (~2 degrees per second).
+#define CFG_IMU_BIAS_ACCEL_VARIANCE 2500  // Max accel variance to be still (bits).
+#define CFG_IMU_BIAS_RATE 0.2f  // Portion of the residual moved into the offsets per window.
+#define CFG_IMU_BIAS_PERSIST_INTERVAL 600000  // Minimum milliseconds between NVM writes.
+#define CFG_IMU_BIAS_PERSIST_DELTA 20  // Minimum offset change to be persisted (bits).
+#define CFG_CALIBRATION_SAMPLES_MIN 20000  // Reads (of every sensor).
+#define CFG_CALIBRATION_SAMPLES_MAX 200000  // Reads (of every sensor).
+#define CFG_CALIBRATION_CHECK_FREQ 5000  // Reads between precision and motion checks.
+#define CFG_CALIBRATION_ERROR_THUMBSTICK 0.0001f  // Target 95% confidence interval (unit value).
+#define CFG_CALIBRATION_ERROR_GYRO 0.5f  // Target 95% confidence interval (bits).
+#define CFG_CALIBRATION_ERROR_ACCEL 1.0f  // Target 95% confidence interval (bits).
+#define CFG_CALIBRATION_MOTION_GYRO 40000  // Max gyro variance, otherwise it was moved (bits).
+#define CFG_CALIBRATION_MOTION_ACCEL 10000  // Max accel variance, otherwise it was moved (bits).
+#define CFG_CALIBRATION_ATTEMPTS 3  // Runs before giving up if motion is detected.
+#define CFG_CALIBRATION_BLINK_FREQ 10000  // Reads.
+
+#define CFG_GYRO_SENSITIVITY  (1.45f / 512)  // 2^-9 * 1.45 (at 250Hz).
+#define CFG_GYRO_DT_REFERENCE 4000  // Microseconds, gyro output tuned for 250Hz.
+#define CFG_GYRO_DT_MAX 20000  // Microseconds, longer gaps count as one tick.
 #define CFG_GYRO_SENSITIVITY_X  CFG_GYRO_SENSITIVITY * 1
 #define CFG_GYRO_SENSITIVITY_Y  CFG_GYRO_SENSITIVITY * 1
 #define CFG_GYRO_SENSITIVITY_Z  CFG_GYRO_SENSITIVITY * 1
 #define CFG_MOUSE_WHEEL_DEBOUNCE 1000
-#define CFG_ACCEL_CORRECTION_SMOOTH 50  // Number of averaged samples for the correction vector.
-#define CFG_ACCEL_CORRECTION_RATE 0.0007  // How fast the correction is applied.
+#define CFG_ACCEL_CORRECTION_SMOOTH (50 / CFG_TICK_SCALE)  // Number of averaged samples for the initial orientation.
+#define CFG_GYRO_MAHONY_KP 0.2f  // Orientation filter, gravity feedback gain (per second).
+#define CFG_GYRO_MAHONY_KI 0.01f  // Orientation filter, gyro bias feedback gain (per second).
+#define CFG_GYRO_MAHONY_ACCEL_RANGE 0.15f  // Gravity feedback only if the accel magnitude is within 1g +/- this.
 
 #define CFG_PRESS_DEBOUNCE 50  // Milliseconds.
 #define CFG_HOLD_EXCLUSIVE_TIME 200  // Milliseconds.
@@ -48,6 +81,13 @@
 #define CFG_THUMBSTICK_SATURATION 1.6
 #define CFG_THUMBSTICK_INNER_RADIUS 0.75
 #define CFG_THUMBSTICK_ADDITIONAL_DEADZONE_FOR_BUTTONS 0.05
+#define CFG_THUMBSTICK_ADC_DMA true  // Free-running ADC into a ring, oversampled reads.
+#define CFG_THUMBSTICK_ADC_RATE 40000  // Conversions per second (both axes).
+#define CFG_THUMBSTICK_ADC_OVERSAMPLE 30  // Samples averaged per axis and read (multiple of 3).
+#define CFG_THUMBSTICK_ADC_MEDIAN false  // Median of 3 partial averages (spike rejection).
+#define CFG_THUMBSTICK_ADC_SMOOTH 0  // IIR filter weight of the previous value (0 = off).
+#define CFG_THUMBSTICK_FILTER_SPEED_CUTOFF 1.0f  // Hz, low-pass of the speed estimate.
+#define CFG_THUMBSTICK_FILTER_DT_MAX 100000  // Microseconds, longer gaps restart the filter.
 
 #define CFG_DHAT_DEBOUNCE_TIME 100  // Milliseconds.
 
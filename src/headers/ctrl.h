@@ -23,6 +23,8 @@ typedef enum Ctrl_msg_type_enum {
     PROFILE_GET,
     PROFILE_SET,
     PROFILE_SHARE,
+    STATS_GET = 13,
+    STATS_SHARE,
 } Ctrl_msg_type;
 
 typedef enum Ctrl_cfg_type_enum {
@@ -136,7 +138,9 @@ typedef struct CtrlThumbstick_struct {
     uint8_t deadzone;
     uint8_t overlap;
     uint8_t deadzone_override;
-    uint8_t padding[53];
+    uint8_t filter_cutoff;  // Tenths of Hz, 0 = no filter.
+    uint8_t filter_beta;  // Tenths of Hz per unit per second.
+    uint8_t padding[51];
 } CtrlThumbstick;
 
 typedef struct CtrlGlyph_struct {
@@ -178,7 +182,8 @@ typedef struct CtrlGyroAxis_struct {
     uint8_t angle_max;
     uint8_t hint_neg[14];
     uint8_t hint_pos[14];
-    uint8_t padding[20];
+    uint8_t curve[8];  // Mouse response curve, see GYRO_CURVE_POINTS.
+    uint8_t padding[12];
 } CtrlGyroAxis;
 
 typedef struct CtrlMacro_struct {
@@ -206,3 +211,4 @@ typedef struct CtrlProfile_struct {
 Ctrl ctrl_log(uint8_t* offset_ptr, uint8_t len);
 Ctrl ctrl_config_share(uint8_t index);
 Ctrl ctrl_profile_share(uint8_t profile_index, uint8_t section_index);
+Ctrl ctrl_stats_share(uint8_t stage);
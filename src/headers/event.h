@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_RING_SLOTS 32  // Must be a power of 2.
+
+typedef enum EventType_enum {
+    EVENT_ROTARY,
+} EventType;
+
+typedef struct Event_struct {
+    uint32_t timestamp;
+    uint8_t type;
+    int8_t value;
+    uint8_t padding[2];
+} Event;
+
+void event_init();
+bool event_push(EventType type, int8_t value);
+void event_drain();
+void event_log_stats();
@@ -2,6 +2,25 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #pragma once
+#include <stdint.h>
+#include "button.h"
+#include "vector.h"
+
+// Mouse response curve, as gains (percentage) at evenly spaced input speeds,
+// beyond the last point its gain is kept. If all are zero the default curve is
+// used (slower small movements, for precision).
+#define GYRO_CURVE_POINTS 8
+#define GYRO_CURVE_STEP 0.25f  // Pixels per tick (at 250Hz) between points.
+// The curve is compiled into a lookup table of the output at evenly spaced
+// inputs (1/16 pixel), both in 16.16 fixed point.
+#define GYRO_CURVE_LUT 32  // Intervals, must cover all the curve points.
+#define GYRO_CURVE_SHIFT 12  // Input bits per interval.
+#define GYRO_CURVE_RANGE (GYRO_CURVE_LUT << GYRO_CURVE_SHIFT)
+
+typedef struct GyroCurve_struct {
+    int32_t lut[GYRO_CURVE_LUT + 1];
+    int32_t gain;  // Beyond the table, 16.16 fixed point.
+} GyroCurve;
 
 typedef enum GyroMode_enum {
     GYRO_MODE_OFF,
@@ -18,18 +37,18 @@ struct Gyro_struct {
     void (*report_incremental) (Gyro *self);
     void (*report_absolute) (Gyro *self);
     void (*reset) (Gyro *self);
-    void (*config_x) (Gyro *self, double min, double max, Actions neg, Actions pos);
-    void (*config_y) (Gyro *self, double min, double max, Actions neg, Actions pos);
-    void (*config_z) (Gyro *self, double min, double max, Actions neg, Actions pos);
+    void (*config_x) (Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve);
+    void (*config_y) (Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve);
+    void (*config_z) (Gyro *self, double min, double max, Actions neg, Actions pos, uint8_t *curve);
     GyroMode mode;
     uint8_t engage;
     Button engage_button;
-    double absolute_x_min;
-    double absolute_y_min;
-    double absolute_z_min;
-    double absolute_x_max;
-    double absolute_y_max;
-    double absolute_z_max;
+    float absolute_x_min;
+    float absolute_y_min;
+    float absolute_z_min;
+    float absolute_x_max;
+    float absolute_y_max;
+    float absolute_z_max;
     bool pressed_x_pos;
     bool pressed_y_pos;
     bool pressed_z_pos;
@@ -42,6 +61,9 @@ struct Gyro_struct {
     Actions actions_x_neg;
     Actions actions_y_neg;
     Actions actions_z_neg;
+    GyroCurve curve_x;
+    GyroCurve curve_y;
+    GyroCurve curve_z;
 };
 
 Gyro Gyro_ (
@@ -51,3 +73,7 @@ Gyro Gyro_ (
 
 void gyro_update_sensitivity();
 void gyro_wheel_antideadzone(int8_t increment);
+void gyro_curve_compile(GyroCurve *curve, uint8_t *points);
+int32_t gyro_curve(GyroCurve *curve, int32_t value);
+void gyro_orientation_reset();
+void gyro_orientation_update(Vector gyro, Vector accel, uint32_t dt);
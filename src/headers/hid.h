@@ -3,6 +3,7 @@
 
 #pragma once
 #include <pico/time.h>
+#include "axis.h"
 #include "common.h"
 
 #define MODIFIER_INDEX 154
@@ -11,6 +12,27 @@
 #define GAMEPAD_AXIS_INDEX 190
 #define PROC_INDEX 202
 
+typedef enum HidReportClass_enum {
+    HID_REPORT_KEYBOARD,
+    HID_REPORT_MOUSE,
+    HID_REPORT_GAMEPAD,
+    HID_REPORT_CLASSES,
+} HidReportClass;
+
+// Delayed actions (see hid_press_later and others).
+typedef enum HidLater_enum {
+    HID_LATER_PRESS,
+    HID_LATER_RELEASE,
+    HID_LATER_PRESS_MULTIPLE,
+    HID_LATER_RELEASE_MULTIPLE,
+    HID_LATER_THANKS,
+} HidLater;
+
+#define DIRTY_KEYBOARD (1 << HID_REPORT_KEYBOARD)
+#define DIRTY_MOUSE (1 << HID_REPORT_MOUSE)
+#define DIRTY_GAMEPAD (1 << HID_REPORT_GAMEPAD)
+#define DIRTY_ALL (DIRTY_KEYBOARD | DIRTY_MOUSE | DIRTY_GAMEPAD)
+
 #define MODIFIER_INDEX_END  MOUSE_INDEX - 1
 #define MOUSE_INDEX_END  GAMEPAD_INDEX - 1
 #define GAMEPAD_INDEX_END  GAMEPAD_AXIS_INDEX - 1
@@ -264,7 +286,9 @@
 #define PROC_ADZN   PROC_INDEX + 41
 
 void hid_thanks();
+void hid_thanks_();
 void hid_matrix_reset();
+void hid_gamepad_reset();
 void hid_press(uint8_t key);
 void hid_release(uint8_t key);
 void hid_press_multiple(uint8_t *keys);
@@ -273,21 +297,23 @@ void hid_press_later(uint8_t key, uint16_t delay);
 void hid_release_later(uint8_t key, uint16_t delay);
 void hid_press_multiple_later(uint8_t *keys, uint16_t delay);
 void hid_release_multiple_later(uint8_t *keys, uint16_t delay);
-void hid_press_later_callback(alarm_id_t alarm, uint8_t key);
-void hid_release_later_callback(alarm_id_t alarm, uint8_t key);
-void hid_press_multiple_later_callback(alarm_id_t alarm, uint8_t *keys);
-void hid_release_multiple_later_callback(alarm_id_t alarm, uint8_t *keys);
 void hid_macro(uint8_t index);
 bool hid_is_axis(uint8_t key);
 void hid_mouse_move(int16_t x, int16_t y);
 void hid_mouse_wheel(int8_t z);
-void hid_gamepad_lx(double value);
-void hid_gamepad_ly(double value);
-void hid_gamepad_rx(double value);
-void hid_gamepad_ry(double value);
-void hid_gamepad_lz(double value);
-void hid_gamepad_rz(double value);
+void hid_gamepad_lx(Axis value);
+void hid_gamepad_ly(Axis value);
+void hid_gamepad_rx(Axis value);
+void hid_gamepad_ry(Axis value);
+void hid_gamepad_lz(Axis value);
+void hid_gamepad_rz(Axis value);
 void hid_report();
+void hid_report_drain();
+void hid_report_discard();
+void hid_keyboard_queue();
+void hid_mouse_queue();
+void hid_gamepad_queue();
+void hid_log_report_stats();
 void hid_init();
 
 extern bool hid_allow_communication;
@@ -14,15 +14,75 @@
 #define IMU_CTRL3_C 0x12  // IMU config address.
 #define IMU_CTRL8_XL 0x17  // Accelerometer filter config address.
 #define IMU_CTRL8_XL_LP 0b00000000  // Accelerometer filter config value.
+#define IMU_STATUS_REG 0x1E  // Data ready address (followed by temperature and outputs).
+#define IMU_STATUS_XLDA 0b00000001  // New accelerometer data.
+#define IMU_STATUS_GDA 0b00000010  // New gyroscope data.
 #define IMU_OUTX_L_G 0x22  // Gyroscope read X address.
 #define IMU_OUTY_L_G 0x24  // Gyroscope read Y address.
 #define IMU_OUTZ_L_G 0x26  // Gyroscope read Z address.
 #define IMU_OUTX_L_XL 0x28  // Accelerometer read X address.
 #define IMU_OUTY_L_XL 0x30  // Accelerometer read Y address.
 #define IMU_OUTZ_L_XL 0x2A  // Accelerometer read Z address.
+#define IMU_FIFO_CTRL1 0x07  // FIFO watermark address (low bits).
+#define IMU_FIFO_CTRL2 0x08  // FIFO watermark address (high bit).
+#define IMU_FIFO_CTRL3 0x09  // FIFO batching data rate address.
+#define IMU_FIFO_CTRL3_GYRO 0b10100000  // Batch gyro at 6667Hz, no accel.
+#define IMU_FIFO_CTRL4 0x0A  // FIFO mode address.
+#define IMU_FIFO_CTRL4_CONTINUOUS 0b00000110  // Continuous, oldest overwritten.
+#define IMU_FIFO_CTRL4_BYPASS 0b00000000  // FIFO disabled (and emptied).
+#define IMU_FIFO_STATUS1 0x3A  // FIFO unread words address (2 bytes).
+#define IMU_FIFO_DATA_OUT_TAG 0x78  // FIFO output address (tag + 6 bytes).
+#define IMU_FIFO_TAG_GYRO 0x01  // FIFO tag sensor value for gyro.
+#define IMU_FIFO_WORD 7  // Bytes per FIFO word.
+#define IMU_FIFO_BURST 64  // Max FIFO words used per tick (older words of larger backlogs skipped).
+#define IMU_FIFO_ODR 6667  // Hz, gyro batching data rate.
+#define IMU_FIFO_GAP ((CFG_GYRO_DT_MAX * IMU_FIFO_ODR) / 1000000)  // Larger backlogs are flushed.
+
+// Asynchronous reads only work with the FIFO, and are not needed when the
+// sensors are sampled by core 1.
+#define IMU_ASYNC (CFG_IMU_ASYNC && CFG_IMU_FIFO && !CFG_DUAL_CORE)
+#define IMU_ASYNC_ACCEL 4  // Steps: FIFO status and data for each IMU,
+#define IMU_ASYNC_DONE 6  // then the accelerometer of each IMU.
+
+typedef struct ImuSample_struct {
+    Vector gyro;
+    Vector accel;
+    uint32_t timestamp;  // Microseconds.
+    uint32_t dt;  // Microseconds of motion covered by the gyro value.
+} ImuSample;
+
+// Gyro and accelerometer statistics of the current bias estimation window.
+typedef struct ImuBias_struct {
+    uint32_t start;  // Microseconds.
+    uint32_t accel_last;  // Microseconds.
+    uint32_t last;  // Microseconds, previous update.
+    uint32_t samples;
+    uint32_t accel_samples;
+    Vector gyro_sum[2];
+    Vector gyro_sq[2];
+    Vector accel_ref;  // Accel values are relative to the first one (precision).
+    Vector accel_sum;
+    Vector accel_sq;
+} ImuBias;
+
+typedef struct ImuAsyncBlock_struct {
+    uint8_t status[2][2];
+    uint16_t words[2];  // Words in data.
+    uint16_t backlog[2];  // Words that were in the FIFO.
+    uint8_t data[2][IMU_FIFO_BURST * IMU_FIFO_WORD];
+    uint8_t accel[2][6];
+} ImuAsyncBlock;
 
 void imu_init();
+void imu_update_offsets();
+uint8_t imu_read_raw(uint8_t cs, Vector *gyro, Vector *accel);
 Vector imu_read_gyro();
+Vector imu_read_gyro_fifo(uint8_t cs);
+Vector imu_read_gyro_async(Vector *imu1, Vector *accel);
 Vector imu_read_accel();
-void imu_calibrate();
+Vector imu_read_accel_bits(uint8_t cs);
+ImuSample imu_read_sample();
+void imu_bias_update(Vector imu0, Vector imu1, Vector *accel);
+void imu_bias_reset();
+void imu_bias_sync();
 
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MACRO_LEN 28  // Bytes per macro, see CtrlMacro.
+#define MACRO_SLOTS 8  // PROC_MACRO_1 to PROC_MACRO_8.
+#define MACRO_STEPS_MAX 32  // Instructions executed per tick (loop guard).
+#define MACRO_LEGACY_DELAY 10  // Milliseconds, press and release of flat macros.
+
+// First byte of a bytecode macro, otherwise it is a flat list of keys.
+#define MACRO_MAGIC 0xFF
+
+typedef enum MacroOp_enum {
+    MACRO_END,           // End of the macro (also the end of the buffer).
+    MACRO_PRESS,         // [key] Press key.
+    MACRO_RELEASE,       // [key] Release key.
+    MACRO_WAIT,          // [ms] Wait milliseconds (rounded up to ticks).
+    MACRO_REPEAT,        // [offset, n] Jump back to offset n more times,
+                         // or while the trigger is held if n is 0.
+    MACRO_WAIT_RELEASE,  // Wait until the trigger is released.
+} MacroOp;
+
+typedef struct MacroRunner_struct {
+    uint8_t *code;
+    bool active;
+    bool legacy;
+    bool held;
+    uint8_t pc;
+    uint16_t wait;
+    int16_t loop;
+    uint32_t pressed[8];  // Keys pressed by the macro and not yet released.
+} MacroRunner;
+
+void macro_start(uint8_t index, uint8_t *code);
+void macro_release(uint8_t index);
+void macro_tick();
+void macro_reset();
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Slopes (tangent of an angle) as fixed point with this many fractional bits.
+#define POLAR_SLOPE_BITS 12
+#define POLAR_SLOPE_22_5 1697  // tan(22.5 degrees).
+#define POLAR_SLOPE_45 4096  // tan(45 degrees).
+
+uint32_t polar_isqrt(uint32_t value);
+uint32_t polar_magnitude(int32_t x, int32_t y);
+uint16_t polar_slope(float degrees);
+bool polar_angle_ge(int32_t opposite, int32_t adjacent, uint16_t slope);
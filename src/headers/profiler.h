@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+
+// Log-linear histogram, 8 sub-buckets per power of 2, exact below 16us,
+// covers up to 65ms (values above are accumulated in the last bucket).
+#define PROFILER_LINEAR 16
+#define PROFILER_SUB_BUCKETS 8
+#define PROFILER_BUCKETS 112
+
+// Stage indexes are shared with the Ctrl protocol, therefore starting at 1.
+typedef enum ProfilerStage_enum {
+    STAGE_TICK = 1,
+    STAGE_SAMPLER,
+    STAGE_CONFIG_SYNC,
+    STAGE_IO_CACHE,
+    STAGE_BUTTONS,
+    STAGE_DHAT,
+    STAGE_ROTARY,
+    STAGE_THUMBSTICK,
+    STAGE_GYRO,
+    STAGE_HID_REPORT,
+    STAGE_TUD_TASK,
+    STAGE_REPORT_AGE,
+    STAGE_EVENT_LATENCY,
+    STAGE_LAST,
+} ProfilerStage;
+
+typedef struct ProfilerSummary_struct {
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint16_t avg;
+    uint16_t p50;
+    uint16_t p90;
+    uint16_t p99;
+} ProfilerSummary;
+
+void profiler_start(ProfilerStage stage);
+void profiler_stop(ProfilerStage stage);
+void profiler_record(ProfilerStage stage, uint32_t value);
+void profiler_reset();
+ProfilerSummary profiler_summary(ProfilerStage stage);
+void profiler_log(ProfilerStage stage);
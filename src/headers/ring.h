@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Single-producer single-consumer ring of fixed size slots.
+// The producer only writes the head and the consumer only writes the tail,
+// so it can be shared between the two cores (or two threads) without locks.
+typedef struct Ring_struct {
+    uint32_t head;
+    uint32_t tail;
+    uint8_t *buffer;
+    uint16_t slot_size;
+    uint16_t slots;  // Must be a power of 2.
+    uint32_t dropped;
+} Ring;
+
+Ring Ring_(void *buffer, uint16_t slot_size, uint16_t slots);
+
+bool ring_push(Ring *ring, void *item);
+bool ring_pop(Ring *ring, void *item);
+uint16_t ring_len(Ring *ring);
+void ring_clear(Ring *ring);
@@ -26,3 +26,4 @@ Rotary Rotary_ ();
 
 void rotary_init();
 void rotary_set_mode(uint8_t value);
+void rotary_event(int8_t increment, uint32_t timestamp);
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "imu.h"
+
+#define SAMPLER_RING_SLOTS 16  // Must be a power of 2.
+
+typedef struct SamplerSample_struct {
+    uint32_t timestamp;  // Microseconds.
+    uint32_t touch_elapsed;
+    uint16_t thumbstick_x;
+    uint16_t thumbstick_y;
+    Vector gyro;
+    Vector accel;
+    uint32_t dt;  // Microseconds covered by the gyro value.
+} SamplerSample;
+
+void sampler_init();
+void sampler_update();
+void sampler_pause();
+void sampler_resume();
+bool sampler_is_running();
+
+Vector sampler_read_gyro();
+Vector sampler_read_accel();
+ImuSample sampler_read_imu();
+uint16_t sampler_read_thumbstick_x();
+uint16_t sampler_read_thumbstick_y();
+uint32_t sampler_read_touch();
@@ -5,6 +5,10 @@
 #include "common.h"
 #include "button.h"
 #include "glyph.h"
+#include "axis.h"
+
+#define THUMBSTICK_ADC_RING 256  // Samples, must be a power of 2.
+#define THUMBSTICK_ADC_RING_BITS 9  // Log2 of the ring size in bytes.
 
 typedef enum ThumbstickMode_enum {
     THUMBSTICK_MODE_OFF,
@@ -17,12 +21,23 @@ typedef enum ThumbstickDistance_enum {
     THUMBSTICK_DISTANCE_RADIAL,
 } ThumbstickDistance;
 
+// Cartesian values after the deadzone, in the same direction as the input.
 typedef struct ThumbstickPosition_struct {
+    Axis x;
+    Axis y;
+    Axis radius;
+} ThumbstickPosition;
+
+// Adaptive low-pass filter (One-Euro), see thumbstick_filter.
+typedef struct ThumbstickFilter_struct {
+    float min_cutoff;  // Hz, 0 = disabled.
+    float beta;  // Cutoff increase (Hz) per unit per second of speed.
     float x;
     float y;
-    float angle;
-    float radius;
-} ThumbstickPosition;
+    float speed_x;
+    float speed_y;
+    bool primed;
+} ThumbstickFilter;
 
 typedef enum Dir4Mask_enum {
     DIR4_MASK_LEFT = 1,
@@ -68,6 +83,9 @@ struct Thumbstick_struct {
     bool deadzone_override;
     float deadzone;
     float overlap;
+    uint16_t overlap_slope;  // See polar_slope.
+    ThumbstickFilter filter;
+    uint32_t filter_timestamp;
     Button left;
     Button right;
     Button up;
@@ -86,10 +104,19 @@ Thumbstick Thumbstick_ (
     ThumbstickDistance distance_mode,
     bool deadzone_override,
     float deadzone,
-    float overlap
+    float overlap,
+    float filter_cutoff,
+    float filter_beta
 );
 
 void thumbstick_init();
+uint16_t thumbstick_adc_raw(uint8_t adc_index);
+uint16_t thumbstick_adc_single(uint8_t adc_index);
+void thumbstick_adc_free_running(bool enabled);
 void thumbstick_report();
-void thumbstick_calibrate();
+float thumbstick_adc(uint8_t adc_index, float offset);
+float thumbstick_adc_normalize(uint16_t raw, float offset);
+void thumbstick_update_offsets();
 void thumbstick_update_deadzone();
+void thumbstick_filter_reset(ThumbstickFilter *filter);
+void thumbstick_filter(ThumbstickFilter *filter, float *x, float *y, uint32_t dt);
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TICK_FRAME_US 1000  // USB full speed frame.
+#define TICK_SOF_TIMEOUT 2000  // Microseconds without SOF to consider it lost.
+#define TICK_DRAIN_SLICE 250  // Microseconds between HID queue drains while idle.
+
+void tick_init();
+void tick_sof(uint32_t frame);
+void tick_report_queued();
+void tick_idle(uint32_t tick_start, uint32_t tick_completed);
+bool tick_is_synced();
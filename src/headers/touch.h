@@ -4,7 +4,7 @@
 #pragma once
 
 // Smooting of state change for the touch reporting.
-#define CFG_TOUCH_SMOOTH 2  // Ticks.
+#define CFG_TOUCH_SMOOTH (CFG_TICK_FREQUENCY / 125)  // Ticks (8ms).
 
 // The baseline threshold value when using dynamic.
 #define CFG_GEN0_TOUCH_DYNAMIC_MIN 3  // Microseconds
@@ -16,12 +16,13 @@
 
 // Dynamic threshold algorithm tuning.
 #define CFG_TOUCH_DYNAMIC_PEAK_RATIO 0.5
-#define CFG_TOUCH_DYNAMIC_PUSHDOWN_FREQ 250  // Ticks.
+#define CFG_TOUCH_DYNAMIC_PUSHDOWN_FREQ CFG_TICK_FREQUENCY  // Ticks (1 second).
 #define CFG_TOUCH_DYNAMIC_PUSHDOWN_HYPERBOLIC 6
 
 // Debug.
 #define DEBUG_TOUCH_ELAPSED_FREQ 40  // Ticks.
 
 void touch_init();
+uint32_t touch_get_elapsed();
 void touch_update_threshold();
 bool touch_status();
@@ -15,7 +15,11 @@
 #define CFG_TUD_VENDOR_RX_BUFSIZE 64
 #define CFG_TUD_VENDOR_TX_BUFSIZE 64
 
-#define CFG_TUD_HID 1
+// One HID interface (and endpoint) per device class, instead of keyboard,
+// mouse and gamepad sharing a single one. (Preprocessor flag, 0 or 1).
+#define USB_HID_SPLIT 0
+
+#define CFG_TUD_HID (USB_HID_SPLIT ? 3 : 1)
 #define CFG_TUD_CDC 0
 #define CFG_TUD_MSC 0
 #define CFG_TUD_MIDI 0
@@ -24,12 +28,34 @@
 #define ITF_HID 0
 #define ITF_WEBUSB 1
 #define ITF_XINPUT 2
+#define ITF_HID_MOUSE_GENERIC 2  // Split HID only.
+#define ITF_HID_GAMEPAD_GENERIC 3  // Split HID only.
+#define ITF_HID_MOUSE_XINPUT 3  // Split HID only.
 
 #define ADDR_HID_IN 0x86
 #define ADDR_WEBUSB_IN 0x83
 #define ADDR_WEBUSB_OUT 0x04
 #define ADDR_XINPUT_IN 0x81
 #define ADDR_XINPUT_OUT 0x02
+#define ADDR_HID_MOUSE_IN 0x87  // Split HID only.
+#define ADDR_HID_GAMEPAD_IN 0x88  // Split HID only.
+
+// HID instances (split HID), TinyUSB numbers them in descriptor order.
+#define HID_INSTANCE_KEYBOARD 0
+#define HID_INSTANCE_MOUSE 1
+#define HID_INSTANCE_GAMEPAD 2
+
+#define HID_INTERVAL_KEYBOARD 1  // Milliseconds (split HID).
+#define HID_INTERVAL_MOUSE 1
+#define HID_INTERVAL_GAMEPAD 1
+
+// Keyboard report as a bitmap of every key (N-key rollover) instead of a list
+// of up to 6 keys. With split HID the keyboard interface also supports the
+// boot protocol, in which case the 6 keys report is used. (0 or 1).
+#define USB_HID_NKRO 0
+
+// Poll the XInput endpoint every 1ms instead of every 4ms. (0 or 1).
+#define USB_XINPUT_1MS 0
 
 #define REPORT_KEYBOARD 1
 #define REPORT_MOUSE 2
@@ -90,6 +116,17 @@
         1                       /* Interface interval (ms) */\
     )
 
+#define DESCRIPTOR_INTERFACE_HID_SPLIT(itf, addr, report_size, interval, boot) \
+    TUD_HID_DESCRIPTOR( \
+        itf,                    /* Interface index */\
+        ITF_HID + 4,            /* String index */\
+        boot,                   /* Boot protocol */\
+        report_size,            /* Report descriptor length */\
+        addr,                   /* Interface address */\
+        32,                     /* Endpoint buffer size */\
+        interval                /* Interface interval (ms) */\
+    )
+
 #define DESCRIPTOR_INTERFACE_WEBUSB \
     TUD_VENDOR_DESCRIPTOR( \
         ITF_WEBUSB,       /* Interface index */\
@@ -122,7 +159,7 @@
     ADDR_XINPUT_IN,  /* bEndpointAddress */\
     0x03,            /* bmAttributes */\
     0x20, 0x00,      /* wMaxPacketSize */\
-    0x04             /* bInterval */\
+    (USB_XINPUT_1MS ? 0x01 : 0x04)  /* bInterval */\
 
 #define DESCRIPTOR_ENDPOINT_XINPUT_OUT \
     0x07,             /* bLength */\
@@ -251,6 +288,55 @@
     HID_COLLECTION_END                                            , \
   HID_COLLECTION_END \
 
+#define HID_NKRO_KEYS 116  // Keycodes 0 to 115, same as the 6 keys report.
+#define HID_NKRO_BYTES ((HID_NKRO_KEYS + 7) / 8)
+
+// Keyboard HID definition with N-key rollover, modifiers and then one bit per
+// keycode (up to HID_NKRO_KEYS), LEDs output same as the default keyboard.
+#define TUD_HID_REPORT_DESC_KEYBOARD_NKRO(...) \
+  HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP     )                  ,\
+  HID_USAGE      ( HID_USAGE_DESKTOP_KEYBOARD )                  ,\
+  HID_COLLECTION ( HID_COLLECTION_APPLICATION )                  ,\
+    /* Report ID if any */\
+    __VA_ARGS__ \
+    /* 8 bits modifier */ \
+    HID_USAGE_PAGE    ( HID_USAGE_PAGE_KEYBOARD                ) ,\
+    HID_USAGE_MIN     ( 224                                    ) ,\
+    HID_USAGE_MAX     ( 231                                    ) ,\
+    HID_LOGICAL_MIN   ( 0                                      ) ,\
+    HID_LOGICAL_MAX   ( 1                                      ) ,\
+    HID_REPORT_COUNT  ( 8                                      ) ,\
+    HID_REPORT_SIZE   ( 1                                      ) ,\
+    HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+    /* Keycodes bitmap */ \
+    HID_USAGE_MIN     ( 0                                      ) ,\
+    HID_USAGE_MAX     ( HID_NKRO_KEYS - 1                      ) ,\
+    HID_REPORT_COUNT  ( HID_NKRO_KEYS                          ) ,\
+    HID_REPORT_SIZE   ( 1                                      ) ,\
+    HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+    /* Padding to full byte */ \
+    HID_REPORT_COUNT  ( 1                                      ) ,\
+    HID_REPORT_SIZE   ( (HID_NKRO_BYTES * 8) - HID_NKRO_KEYS   ) ,\
+    HID_INPUT         ( HID_CONSTANT                           ) ,\
+    /* 5 bits LED indicators */ \
+    HID_USAGE_PAGE    ( HID_USAGE_PAGE_LED                     ) ,\
+    HID_USAGE_MIN     ( 1                                      ) ,\
+    HID_USAGE_MAX     ( 5                                      ) ,\
+    HID_REPORT_COUNT  ( 5                                      ) ,\
+    HID_REPORT_SIZE   ( 1                                      ) ,\
+    HID_OUTPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+    /* 3 bits LED padding */ \
+    HID_REPORT_COUNT  ( 1                                      ) ,\
+    HID_REPORT_SIZE   ( 3                                      ) ,\
+    HID_OUTPUT        ( HID_CONSTANT                           ) ,\
+  HID_COLLECTION_END
+
+#if USB_HID_NKRO
+    #define DESCRIPTOR_REPORT_KEYBOARD TUD_HID_REPORT_DESC_KEYBOARD_NKRO
+#else
+    #define DESCRIPTOR_REPORT_KEYBOARD TUD_HID_REPORT_DESC_KEYBOARD
+#endif
+
 // Gamepad HID definition that differs from the default implementation included
 // in TinyUSB. (16bit axis, different button layout).
 // https://github.com/hathach/tinyusb/blob/7bf5923052e5861f54c9cb0581e328f8be26a0a9/src/class/hid/hid_device.h#L315
@@ -284,6 +370,11 @@
     HID_INPUT         ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
   HID_COLLECTION_END
 
+typedef struct {
+  uint8_t modifier;
+  uint8_t keys[HID_NKRO_BYTES];
+} __attribute__((packed)) hid_keyboard_nkro_report_t;
+
 typedef struct {
   uint8_t buttons;
   int16_t x;
@@ -3,10 +3,12 @@
 
 #pragma once
 
+// Single precision, the RP2040 has no FPU but the float routines in ROM are
+// much faster than the software double ones.
 typedef struct vector_struct {
-    double x;
-    double y;
-    double z;
+    float x;
+    float y;
+    float z;
 } Vector;
 
 typedef struct vector4_struct {
@@ -26,6 +28,8 @@ float vector_lenght(Vector v);
 
 Vector4 quaternion(Vector vector, float rotation);
 Vector4 qmultiply(Vector4 q1, Vector4 q2);
+Vector4 qnormalize(Vector4 q);
+Vector4 qbasis(Vector x, Vector y, Vector z);
 Vector4 qconjugate(Vector4 q);
 Vector qrotate(Vector4 q1, Vector v);
 Vector qvector(Vector4 q);
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WHEEL_SLOTS 64  // Per level, must be a power of 2.
+#define WHEEL_SLOTS_BITS 6
+#define WHEEL_EVENTS 128
+#define WHEEL_NONE 0xFFFF
+// Longest delay that can be scheduled (milliseconds from the wheel time), longer
+// ones are clamped.
+#define WHEEL_DELAY_MAX ((WHEEL_SLOTS - 1) * WHEEL_SLOTS)
+
+typedef void (*WheelCallback)(uint8_t action, void *arg);
+
+typedef struct WheelEvent_struct {
+    uint32_t due;
+    uint16_t next;
+    uint8_t action;
+    void *arg;
+} WheelEvent;
+
+// Two levels timing wheel with 1 millisecond resolution, the time only moves
+// forward when the owner calls wheel_advance().
+typedef struct Wheel_struct {
+    uint32_t time;
+    uint16_t head[2][WHEEL_SLOTS];
+    uint16_t tail[2][WHEEL_SLOTS];
+    uint16_t free;
+    uint16_t available;
+    uint32_t dropped;
+    WheelEvent events[WHEEL_EVENTS];
+} Wheel;
+
+void wheel_init(Wheel *wheel, uint32_t now);
+bool wheel_add(Wheel *wheel, uint32_t now, uint16_t delay, uint8_t action, void *arg);
+void wheel_advance(Wheel *wheel, uint32_t now, WheelCallback callback);
+uint16_t wheel_available(Wheel *wheel);
+void wheel_clear(Wheel *wheel);
@@ -2,6 +2,8 @@
 // Copyright (C) 2022, Input Labs Oy.
 
 #pragma once
+#include <stdint.h>
+#include <stdbool.h>
 
 #define XINPUT_REPORT_SIZE 20
 
@@ -19,5 +21,6 @@ typedef struct {
     uint8_t reserved[6];
 } xinput_report;
 
-void xinput_send_report(xinput_report *report);
+bool xinput_send_report(xinput_report *report);
+void xinput_log_stats();
 void xinput_receive_report();
@@ -1,42 +1,97 @@
 // SPDX-License-Identifier: GPL-2.0-only
 // Copyright (C) 2022, Input Labs Oy.
 
+#include <string.h>
 #include <tusb.h>
+#include "axis.h"
 #include "config.h"
 #include "ctrl.h"
 #include "hid.h"
 #include "led.h"
+#include "macro.h"
 #include "profile.h"
 #include "xinput.h"
 #include "common.h"
 #include "webusb.h"
+#include "profiler.h"
+#include "tick.h"
+#include "wheel.h"
 #include "logging.h"
 #include "thanks.c"
 
 bool hid_allow_communication = true;  // Extern.
-bool synced_keyboard = false;
-bool synced_mouse = false;
-bool synced_gamepad = false;
-uint16_t alarms = 0;
-alarm_pool_t *alarm_pool;
-
-uint8_t state_matrix[256] = {0,};
+// Report classes with changes not yet queued, see HidReportClass.
+uint8_t report_dirty = DIRTY_ALL;
+// Delayed actions, see hid_wheel_callback().
+Wheel wheel;
+
+// Pressed keys, as a bitset for reports to be built with word operations,
+// plus a reference count of each key since multiple buttons can be mapped to
+// the same key (a bit is set while its count is above zero). For the scroll
+// keys the count is the number of pending wheel steps.
+uint32_t state_bits[8] = {0,};
+uint8_t state_count[256] = {0,};
 int16_t mouse_x = 0;
 int16_t mouse_y = 0;
-double gamepad_lx = 0;
-double gamepad_ly = 0;
-double gamepad_rx = 0;
-double gamepad_ry = 0;
-double gamepad_lz = 0;
-double gamepad_rz = 0;
+// Axes as Q15, wider than Axis so multiple inputs can be combined.
+int32_t gamepad_lx = 0;
+int32_t gamepad_ly = 0;
+int32_t gamepad_rx = 0;
+int32_t gamepad_ry = 0;
+int32_t gamepad_lz = 0;
+int32_t gamepad_rz = 0;
+
+// Report scheduler, see hid_report_select().
+bool report_pending[HID_REPORT_CLASSES] = {0,};
+uint32_t report_queued_at[HID_REPORT_CLASSES] = {0,};
+uint16_t report_credit[HID_REPORT_CLASSES] = {0,};
+uint32_t report_deferred[HID_REPORT_CLASSES] = {0,};
+uint32_t report_coalesced[HID_REPORT_CLASSES] = {0,};
+const uint16_t report_weight[HID_REPORT_CLASSES] = {
+    CFG_HID_REPORT_WEIGHT_KEYBOARD,
+    CFG_HID_REPORT_WEIGHT_MOUSE,
+    CFG_HID_REPORT_WEIGHT_GAMEPAD,
+};
+const uint32_t report_deadline[HID_REPORT_CLASSES] = {
+    CFG_HID_REPORT_DEADLINE_KEYBOARD,
+    CFG_HID_REPORT_DEADLINE_MOUSE,
+    CFG_HID_REPORT_DEADLINE_GAMEPAD,
+};
+uint8_t keyboard_pending_modifier = 0;
+uint8_t keyboard_pending_keys[6] = {0,};
+hid_keyboard_nkro_report_t keyboard_pending_nkro = {0,};
+hid_mouse_custom_report_t mouse_pending = {0,};
+hid_gamepad_custom_report_t gamepad_pending = {0,};
 
 void hid_matrix_reset() {
-    for(uint8_t i=0; i<255; i++) {
-        state_matrix[i] = 0;
-    }
-    synced_keyboard = false;
-    synced_mouse = false;
-    synced_gamepad = false;
+    memset(state_bits, 0, sizeof(state_bits));
+    memset(state_count, 0, sizeof(state_count));
+    report_dirty = DIRTY_ALL;
+    wheel_clear(&wheel);  // Pending delayed actions are from the old state.
+    macro_reset();
+}
+
+bool hid_state_get(uint8_t key) {
+    return state_bits[key >> 5] & (1u << (key & 31));
+}
+
+void hid_state_clear(uint8_t key) {
+    state_bits[key >> 5] &= ~(1u << (key & 31));
+}
+
+// Get LEN consecutive key states (up to 32) starting from key START.
+uint32_t hid_state_get_range(uint8_t start, uint8_t len) {
+    uint8_t word = start >> 5;
+    uint8_t shift = start & 31;
+    uint32_t value = state_bits[word] >> shift;
+    if (shift + len > 32) value |= state_bits[word + 1] << (32 - shift);
+    return len == 32 ? value : value & ((1u << len) - 1);
+}
+
+void hid_state_set_dirty(uint8_t key) {
+    if (key >= GAMEPAD_INDEX) report_dirty |= DIRTY_GAMEPAD;
+    else if (key >= MOUSE_INDEX) report_dirty |= DIRTY_MOUSE;
+    else report_dirty |= DIRTY_KEYBOARD;
 }
 
 void hid_procedure_press(uint8_t procedure){
@@ -89,16 +144,22 @@ void hid_procedure_press(uint8_t procedure){
 void hid_procedure_release(uint8_t procedure) {
     if (procedure == PROC_HOME) profile_set_home(false);
     if (procedure == PROC_HOME_GAMEPAD) profile_set_home_gamepad(false);
+    if (is_between(procedure, PROC_MACRO_1, PROC_MACRO_8)) {
+        macro_release(procedure - PROC_MACRO_1 + 1);
+    }
 }
 
 void hid_press(uint8_t key) {
     if (key == KEY_NONE) return;
     else if (key >= PROC_INDEX) hid_procedure_press(key);
     else {
-        state_matrix[key] += 1;
-        if (key >= GAMEPAD_INDEX) synced_gamepad = false;
-        else if (key >= MOUSE_INDEX) synced_mouse = false;
-        else synced_keyboard = false;
+        // Reports only change when the key state flips (or a scroll step is
+        // added).
+        if (state_count[key] == BIT_8) return;
+        state_count[key] += 1;
+        if (state_count[key] == 1) state_bits[key >> 5] |= (1u << (key & 31));
+        else if (key != MOUSE_SCROLL_UP && key != MOUSE_SCROLL_DOWN) return;
+        hid_state_set_dirty(key);
     }
 }
 
@@ -108,10 +169,11 @@ void hid_release(uint8_t key) {
     else if (key == MOUSE_SCROLL_DOWN) return;
     else if (key >= PROC_INDEX) hid_procedure_release(key);
     else {
-        state_matrix[key] -= 1;
-        if (key >= GAMEPAD_INDEX) synced_gamepad = false;
-        else if (key >= MOUSE_INDEX) synced_mouse = false;
-        else synced_keyboard = false;
+        if (state_count[key] == 0) return;
+        state_count[key] -= 1;
+        if (state_count[key] > 0) return;
+        hid_state_clear(key);
+        hid_state_set_dirty(key);
     }
 }
 
@@ -129,88 +191,43 @@ void hid_release_multiple(uint8_t *keys) {
     }
 }
 
-void hid_press_later(uint8_t key, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_press_later_callback,
-        (void*)(uint32_t)key,
-        true
-    );
-    alarms++;
-}
-
-void hid_release_later(uint8_t key, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_release_later_callback,
-        (void*)(uint32_t)key,
-        true
-    );
-    alarms++;
-}
-
-void hid_press_multiple_later(uint8_t *keys, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_press_multiple_later_callback,
-        keys,
-        true
-    );
-    alarms++;
+uint32_t hid_now() {
+    return to_ms_since_boot(get_absolute_time());
 }
 
-void hid_release_multiple_later(uint8_t *keys, uint16_t delay) {
-    alarm_pool_add_alarm_in_ms(
-        alarm_pool,
-        delay,
-        (alarm_callback_t)hid_release_multiple_later_callback,
-        keys,
-        true
-    );
-    alarms++;
+// Executed from hid_report() in the main loop (never from an interrupt).
+void hid_wheel_callback(uint8_t action, void *arg) {
+    if (action == HID_LATER_PRESS) hid_press((uint8_t)(uintptr_t)arg);
+    if (action == HID_LATER_RELEASE) hid_release((uint8_t)(uintptr_t)arg);
+    if (action == HID_LATER_PRESS_MULTIPLE) hid_press_multiple(arg);
+    if (action == HID_LATER_RELEASE_MULTIPLE) hid_release_multiple(arg);
+    if (action == HID_LATER_THANKS) hid_thanks_();
 }
 
-void hid_press_later_callback(alarm_id_t alarm, uint8_t key) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_press(key);
-    alarms--;
+void hid_press_later(uint8_t key, uint16_t delay) {
+    wheel_add(&wheel, hid_now(), delay, HID_LATER_PRESS, (void*)(uintptr_t)key);
 }
 
-void hid_release_later_callback(alarm_id_t alarm, uint8_t key) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_release(key);
-    alarms--;
+void hid_release_later(uint8_t key, uint16_t delay) {
+    bool added = wheel_add(&wheel, hid_now(), delay, HID_LATER_RELEASE, (void*)(uintptr_t)key);
+    // Releasing early is better than never releasing.
+    if (!added) hid_release(key);
 }
 
-void hid_press_multiple_later_callback(alarm_id_t alarm, uint8_t *keys) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_press_multiple(keys);
-    alarms--;
+void hid_press_multiple_later(uint8_t *keys, uint16_t delay) {
+    wheel_add(&wheel, hid_now(), delay, HID_LATER_PRESS_MULTIPLE, keys);
 }
 
-void hid_release_multiple_later_callback(alarm_id_t alarm, uint8_t *keys) {
-    alarm_pool_cancel_alarm(alarm_pool, alarm);
-    hid_release_multiple(keys);
-    alarms--;
+void hid_release_multiple_later(uint8_t *keys, uint16_t delay) {
+    bool added = wheel_add(&wheel, hid_now(), delay, HID_LATER_RELEASE_MULTIPLE, keys);
+    if (!added) hid_release_multiple(keys);
 }
 
 void hid_macro(uint8_t index) {
     uint8_t section = SECTION_MACRO_1 + ((index - 1) / 2);
     uint8_t subindex = (index - 1) % 2;
     CtrlProfile *profile = config_profile_read(profile_get_active_index(false));
-    uint8_t *macro = profile->sections[section].macro.macro[subindex];
-    if (alarms > 0) return;  // Disallows parallel macros. TODO fix.
-    uint16_t time = 10;
-    for(uint8_t i=0; i<28; i++) {
-        if (macro[i] == 0) break;
-        hid_press_later(macro[i], time);
-        time += 10;
-        hid_release_later(macro[i], time);
-        time += 10;
-    }
+    macro_start(index, profile->sections[section].macro.macro[subindex]);
 }
 
 bool hid_is_axis(uint8_t key) {
@@ -220,132 +237,159 @@ bool hid_is_axis(uint8_t key) {
 void hid_mouse_move(int16_t x, int16_t y) {
     mouse_x += x;
     mouse_y += y;
-    synced_mouse = false;
+    report_dirty |= DIRTY_MOUSE;
 }
 
-void hid_gamepad_lx(double value) {
+void hid_gamepad_lx(Axis value) {
     if (value == gamepad_lx) return;
     gamepad_lx += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_gamepad_ly(double value) {
+void hid_gamepad_ly(Axis value) {
     if (value == gamepad_ly) return;
     gamepad_ly += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_gamepad_lz(double value) {
+void hid_gamepad_lz(Axis value) {
     if (value == gamepad_lz) return;
     gamepad_lz += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_gamepad_rx(double value) {
+void hid_gamepad_rx(Axis value) {
     if (value == gamepad_rx) return;
     gamepad_rx += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_gamepad_ry(double value) {
+void hid_gamepad_ry(Axis value) {
     if (value == gamepad_ry) return;
     gamepad_ry += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_gamepad_rz(double value) {
+void hid_gamepad_rz(Axis value) {
     if (value == gamepad_rz) return;
     gamepad_rz += value;  // Multiple inputs can be combined.
-    synced_gamepad = false;
+    report_dirty |= DIRTY_GAMEPAD;
 }
 
-void hid_mouse_report() {
-    // Create button bitmask.
-    int8_t buttons = 0;
-    for(int i=0; i<5; i++) {
-        buttons += state_matrix[MOUSE_INDEX + i] << i;
+void hid_report_enqueue(HidReportClass class) {
+    if (report_pending[class]) {
+        report_coalesced[class]++;
+        return;
     }
-    uint8_t scroll = state_matrix[MOUSE_SCROLL_UP] - state_matrix[MOUSE_SCROLL_DOWN];
-    // Create report.
-    hid_mouse_custom_report_t report = {buttons, mouse_x, mouse_y, scroll, 0};
+    report_pending[class] = true;
+    report_queued_at[class] = time_us_32();
+    report_credit[class] = report_weight[class];
+}
+
+void hid_mouse_queue() {
+    int8_t buttons = hid_state_get_range(MOUSE_1, 5);
+    uint8_t scroll = state_count[MOUSE_SCROLL_UP] - state_count[MOUSE_SCROLL_DOWN];
+    // Update report, relative values are added to any unsent ones.
+    mouse_pending.buttons = buttons;
+    mouse_pending.x = constrain(mouse_pending.x + mouse_x, -BIT_15, BIT_15);
+    mouse_pending.y = constrain(mouse_pending.y + mouse_y, -BIT_15, BIT_15);
+    mouse_pending.scroll += scroll;
     // Reset values.
     mouse_x = 0;
     mouse_y = 0;
-    state_matrix[MOUSE_SCROLL_UP] = 0;
-    state_matrix[MOUSE_SCROLL_DOWN] = 0;
-    // Send report.
-    tud_hid_report(REPORT_MOUSE, &report, sizeof(report));
-}
-
-void hid_keyboard_report() {
+    state_count[MOUSE_SCROLL_UP] = 0;
+    state_count[MOUSE_SCROLL_DOWN] = 0;
+    hid_state_clear(MOUSE_SCROLL_UP);
+    hid_state_clear(MOUSE_SCROLL_DOWN);
+    hid_report_enqueue(HID_REPORT_MOUSE);
+}
+
+// Whether the keyboard report is the NKRO bitmap, unless the host requested
+// the boot protocol (only possible with split HID).
+bool hid_keyboard_nkro() {
+    if (!USB_HID_NKRO) return false;
+    if (!USB_HID_SPLIT) return true;
+    return tud_hid_n_get_protocol(HID_INSTANCE_KEYBOARD) != HID_PROTOCOL_BOOT;
+}
+
+// Called by TinyUSB when the host switches between boot and report protocol,
+// the keyboard report is rebuilt in the matching format.
+void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol) {
+    if (instance != HID_INSTANCE_KEYBOARD) return;
+    report_pending[HID_REPORT_KEYBOARD] = false;
+    report_dirty |= DIRTY_KEYBOARD;
+}
+
+void hid_keyboard_queue() {
+    if (hid_keyboard_nkro()) {
+        // The bitmap is the state bitset itself (both little endian), so it
+        // is copied in one go, without the bits beyond the last keycode.
+        keyboard_pending_nkro.modifier = hid_state_get_range(MODIFIER_INDEX, 8);
+        memcpy(keyboard_pending_nkro.keys, state_bits, HID_NKRO_BYTES);
+        keyboard_pending_nkro.keys[HID_NKRO_BYTES - 1] &= (1 << (HID_NKRO_KEYS % 8)) - 1;
+        hid_report_enqueue(HID_REPORT_KEYBOARD);
+        return;
+    }
     uint8_t report[6] = {0};
     uint8_t keys_available = 6;
-    for(int i=0; i<=115; i++) {
-        if (state_matrix[i] >= 1) {
-            report[keys_available - 1] = (uint8_t)i;
+    // Iterate only over the pressed keys (keycodes 0 to 115).
+    for(uint8_t w=0; w<4 && keys_available; w++) {
+        uint32_t word = state_bits[w];
+        if (w == 3) word &= (1u << (116 - 96)) - 1;
+        while (word && keys_available) {
+            uint8_t bit = __builtin_ctz(word);
+            word &= word - 1;
+            report[keys_available - 1] = (w * 32) + bit;
             keys_available--;
-            if (keys_available == 0) {
-                break;
-            }
         }
     }
-    uint8_t modifier = 0;
-    for(int i=0; i<8; i++) {
-        modifier += !!state_matrix[MODIFIER_INDEX + i] << i;
-    }
-    tud_hid_keyboard_report(
-        REPORT_KEYBOARD,
-        modifier,
-        report
-    );
+    uint8_t modifier = hid_state_get_range(MODIFIER_INDEX, 8);
+    keyboard_pending_modifier = modifier;
+    memcpy(keyboard_pending_keys, report, 6);
+    hid_report_enqueue(HID_REPORT_KEYBOARD);
 }
 
-double hid_axis(
-    double value,
+Axis hid_axis(
+    int32_t value,
     uint8_t matrix_index_pos,
     uint8_t matrix_index_neg
 ) {
     if (matrix_index_neg) {
-        if (state_matrix[matrix_index_neg]) return -1;
-        else if (state_matrix[matrix_index_pos]) return 1;
-        else return constrain(value, -1, 1);
+        if (hid_state_get(matrix_index_neg)) return AXIS_MIN;
+        else if (hid_state_get(matrix_index_pos)) return AXIS_MAX;
+        else return axis_saturate(value);
     } else {
-        if (state_matrix[matrix_index_pos]) return 1;
-        else return constrain(fabs(value), 0, 1);
+        if (hid_state_get(matrix_index_pos)) return AXIS_MAX;
+        else return axis_abs(axis_saturate(value));
     }
 }
 
-void hid_gamepad_report() {
+void hid_gamepad_queue() {
     // Sorted so the most common assigned buttons are lower and easier to
-    // identify in-game.
+    // identify in-game. (A B X Y L1 R1 L3 R3 Left Right Up Down Select Start
+    // Home).
+    uint32_t state = hid_state_get_range(GAMEPAD_INDEX, 16);
     int32_t buttons = (
-        (state_matrix[GAMEPAD_A]      <<  0) +
-        (state_matrix[GAMEPAD_B]      <<  1) +
-        (state_matrix[GAMEPAD_X]      <<  2) +
-        (state_matrix[GAMEPAD_Y]      <<  3) +
-        (state_matrix[GAMEPAD_L1]     <<  4) +
-        (state_matrix[GAMEPAD_R1]     <<  5) +
-        (state_matrix[GAMEPAD_L3]     <<  6) +
-        (state_matrix[GAMEPAD_R3]     <<  7) +
-        (state_matrix[GAMEPAD_LEFT]   <<  8) +
-        (state_matrix[GAMEPAD_RIGHT]  <<  9) +
-        (state_matrix[GAMEPAD_UP]     << 10) +
-        (state_matrix[GAMEPAD_DOWN]   << 11) +
-        (state_matrix[GAMEPAD_SELECT] << 12) +
-        (state_matrix[GAMEPAD_START]  << 13) +
-        (state_matrix[GAMEPAD_HOME]   << 14)
+        ((state >> 12) & 0b1111) |      // A B X Y.
+        (((state >> 8) & 0b11) << 4) |  // L1 R1.
+        (((state >> 6) & 0b11) << 6) |  // L3 R3.
+        (((state >> 2) & 0b11) << 8) |  // Left Right.
+        ((state & 0b11) << 10) |        // Up Down.
+        (((state >> 5) & 1) << 12) |    // Select.
+        (((state >> 4) & 1) << 13) |    // Start.
+        (((state >> 10) & 1) << 14)     // Home.
     );
-    // Adjust range from [-1,1] to [-32767,32767].
-    int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG) * BIT_15;
-    int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG) * BIT_15;
-    int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG) * BIT_15;
-    int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG) * BIT_15;
+    // Axes are already in the range [-32767,32767].
+    int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG);
+    int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG);
+    int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG);
+    int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG);
     // HID triggers must be also defined as unsigned in the USB descriptor, and has to be manually
     // value-shifted from signed to unsigned here, otherwise Windows is having erratic behavior and
     // inconsistencies between games (not sure if a bug in Windows' DirectInput or TinyUSB).
-    int16_t lz_report = ((hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0) * 2) - 1) * BIT_15;
-    int16_t rz_report = ((hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0) * 2) - 1) * BIT_15;
-    hid_gamepad_custom_report_t report = {
+    int16_t lz_report = axis_to_trigger_signed(hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0));
+    int16_t rz_report = axis_to_trigger_signed(hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0));
+    gamepad_pending = (hid_gamepad_custom_report_t){
         lx_report,
         ly_report,
         rx_report,
@@ -354,26 +398,21 @@ void hid_gamepad_report() {
         rz_report,
         buttons,
     };
-    tud_hid_report(REPORT_GAMEPAD, &report, sizeof(report));
+    hid_report_enqueue(HID_REPORT_GAMEPAD);
 }
 
 void hid_xinput_report() {
-    int8_t buttons_0 = 0;
-    int8_t buttons_1 = 0;
-    for(int i=0; i<8; i++) {
-        buttons_0 += state_matrix[GAMEPAD_INDEX + i] << i;
-    }
-    for(int i=0; i<8; i++) {
-        buttons_1 += state_matrix[GAMEPAD_INDEX + i + 8] << i;
-    }
-    // Adjust range from [-1,1] to [-32767,32767].
-    int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG) * BIT_15;
-    int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG) * BIT_15;
-    int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG) * BIT_15;
-    int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG) * BIT_15;
+    uint32_t state = hid_state_get_range(GAMEPAD_INDEX, 16);
+    int8_t buttons_0 = state & BIT_8;
+    int8_t buttons_1 = state >> 8;
+    // Axes are already in the range [-32767,32767].
+    int16_t lx_report = hid_axis(gamepad_lx, GAMEPAD_AXIS_LX, GAMEPAD_AXIS_LX_NEG);
+    int16_t ly_report = hid_axis(gamepad_ly, GAMEPAD_AXIS_LY, GAMEPAD_AXIS_LY_NEG);
+    int16_t rx_report = hid_axis(gamepad_rx, GAMEPAD_AXIS_RX, GAMEPAD_AXIS_RX_NEG);
+    int16_t ry_report = hid_axis(gamepad_ry, GAMEPAD_AXIS_RY, GAMEPAD_AXIS_RY_NEG);
     // Adjust range from [0,1] to [0,255].
-    uint16_t lz_report = hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0) * BIT_8;
-    uint16_t rz_report = hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0) * BIT_8;
+    uint16_t lz_report = axis_to_trigger(hid_axis(gamepad_lz, GAMEPAD_AXIS_LZ, 0));
+    uint16_t rz_report = axis_to_trigger(hid_axis(gamepad_rz, GAMEPAD_AXIS_RZ, 0));
     xinput_report report = {
         .report_id   = 0,
         .report_size = XINPUT_REPORT_SIZE,
@@ -387,7 +426,7 @@ void hid_xinput_report() {
         .ry          = -ry_report,
         .reserved    = {0, 0, 0, 0, 0, 0}
     };
-    xinput_send_report(&report);
+    if (xinput_send_report(&report)) tick_report_queued();
 }
 
 void hid_gamepad_reset() {
@@ -399,21 +438,148 @@ void hid_gamepad_reset() {
     gamepad_rz = 0;
 }
 
+// Choose which of the queued reports goes next. Reports that are past their
+// deadline go first (the most overdue one), otherwise the one with the most
+// credit, which grows by the class weight every time the report is deferred.
+int8_t hid_report_select() {
+    uint32_t now = time_us_32();
+    int8_t selected = -1;
+    int32_t selected_overdue = -1;
+    for(uint8_t i=0; i<HID_REPORT_CLASSES; i++) {
+        if (!report_pending[i]) continue;
+        int32_t overdue = (int32_t)(now - report_queued_at[i] - report_deadline[i]);
+        if (overdue > selected_overdue) {
+            selected = i;
+            selected_overdue = overdue;
+        }
+    }
+    if (selected == -1) {
+        for(uint8_t i=0; i<HID_REPORT_CLASSES; i++) {
+            if (!report_pending[i]) continue;
+            if (selected == -1 || report_credit[i] > report_credit[selected]) {
+                selected = i;
+            }
+        }
+    }
+    if (selected == -1) return -1;
+    for(uint8_t i=0; i<HID_REPORT_CLASSES; i++) {
+        if (!report_pending[i] || i == selected) continue;
+        report_credit[i] = min(report_credit[i] + report_weight[i], BIT_16);
+        report_deferred[i]++;
+    }
+    return selected;
+}
+
+// With split HID every report class has its own interface instance (in the
+// same order as the classes), otherwise they share instance 0 and are told
+// apart by the report ID.
+uint8_t hid_report_instance(HidReportClass class) {
+    return USB_HID_SPLIT ? class : 0;
+}
+
+void hid_report_send(HidReportClass class) {
+    uint8_t instance = hid_report_instance(class);
+    report_pending[class] = false;
+    // TinyUSB copies the report into its own buffer.
+    if (class == HID_REPORT_KEYBOARD && hid_keyboard_nkro()) {
+        uint8_t report_id = USB_HID_SPLIT ? 0 : REPORT_KEYBOARD;
+        tud_hid_n_report(
+            instance,
+            report_id,
+            &keyboard_pending_nkro,
+            sizeof(keyboard_pending_nkro)
+        );
+    }
+    else if (class == HID_REPORT_KEYBOARD) {
+        tud_hid_n_keyboard_report(
+            instance,
+            USB_HID_SPLIT ? 0 : REPORT_KEYBOARD,
+            keyboard_pending_modifier,
+            keyboard_pending_keys
+        );
+    }
+    else if (class == HID_REPORT_MOUSE) {
+        uint8_t report_id = USB_HID_SPLIT ? 0 : REPORT_MOUSE;
+        tud_hid_n_report(instance, report_id, &mouse_pending, sizeof(mouse_pending));
+        mouse_pending = (hid_mouse_custom_report_t){0,};
+    }
+    else if (class == HID_REPORT_GAMEPAD) {
+        uint8_t report_id = USB_HID_SPLIT ? 0 : REPORT_GAMEPAD;
+        tud_hid_n_report(instance, report_id, &gamepad_pending, sizeof(gamepad_pending));
+    }
+    tick_report_queued();
+}
+
+bool hid_report_send_next() {
+    if (USB_HID_SPLIT) {
+        // Each class has its own endpoint, nothing to choose between.
+        bool sent = false;
+        for(uint8_t i=0; i<HID_REPORT_CLASSES; i++) {
+            if (report_pending[i] && tud_hid_n_ready(hid_report_instance(i))) {
+                hid_report_send(i);
+                sent = true;
+            }
+        }
+        return sent;
+    }
+    if (!tud_hid_ready()) return false;
+    int8_t class = hid_report_select();
+    if (class == -1) return false;
+    hid_report_send(class);
+    return true;
+}
+
+// Called by TinyUSB (from tud_task) when the previous report was delivered,
+// so the queue keeps draining on every poll without waiting for the next tick.
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len) {
+    hid_report_send_next();
+}
+
+// Give TinyUSB the chance to deliver queued reports while the tick is idling.
+void hid_report_drain() {
+    if (!hid_allow_communication) return;
+    if (
+        !report_pending[HID_REPORT_KEYBOARD] &&
+        !report_pending[HID_REPORT_MOUSE] &&
+        !report_pending[HID_REPORT_GAMEPAD]
+    ) {
+        return;
+    }
+    tud_task();
+    if (tud_ready()) hid_report_send_next();
+}
+
+// Drop any queued report (and its statistics), used by the benchmark so the
+// generated reports are not sent.
+void hid_report_discard() {
+    for(uint8_t i=0; i<HID_REPORT_CLASSES; i++) {
+        report_pending[i] = false;
+        report_coalesced[i] = 0;
+    }
+}
+
+void hid_log_report_stats() {
+    debug(
+        "Reports: deferred kb=%lu m=%lu gp=%lu coalesced kb=%lu m=%lu gp=%lu\n",
+        report_deferred[HID_REPORT_KEYBOARD],
+        report_deferred[HID_REPORT_MOUSE],
+        report_deferred[HID_REPORT_GAMEPAD],
+        report_coalesced[HID_REPORT_KEYBOARD],
+        report_coalesced[HID_REPORT_MOUSE],
+        report_coalesced[HID_REPORT_GAMEPAD]
+    );
+}
+
 void hid_report() {
     static bool is_tud_ready = false;
     static bool is_tud_ready_logged = false;
-    static uint8_t priority_mouse = 0;
-    static uint8_t priority_gamepad = 0;
-
-    // Not all events are sent everytime, they are delivered based on their
-    // priority ratio and how long they have been queueing.
-    // For example thumbstick movement may be queued for some cycles if there
-    // is a lot of mouse data being sent.
-    if (!synced_mouse) priority_mouse += 1 * CFG_HID_REPORT_PRIORITY_RATIO;
-    if (!synced_gamepad) priority_gamepad += 1;
 
+    wheel_advance(&wheel, hid_now(), hid_wheel_callback);
+    macro_tick();
     if (!hid_allow_communication) return;
+    profiler_start(STAGE_TUD_TASK);
     tud_task();
+    profiler_stop(STAGE_TUD_TASK);
     if (tud_ready()) {
         is_tud_ready = true;
         if (!is_tud_ready_logged) {
@@ -423,27 +589,30 @@ void hid_report() {
         if (tud_hid_ready()) {
             webusb_read();
             webusb_flush();
-            if (!synced_keyboard) {
-                hid_keyboard_report();
-                synced_keyboard = true;
-            }
-            else if (!synced_mouse && (priority_mouse > priority_gamepad)) {
-                hid_mouse_report();
-                synced_mouse = true;
-                priority_mouse = 0;
-            }
-            else if (!synced_gamepad && config_get_protocol() == PROTOCOL_GENERIC) {
-                hid_gamepad_report();
-                synced_gamepad = true;
-                priority_gamepad = 0;
-            }
         }
-        if (!synced_gamepad && config_get_protocol() != PROTOCOL_GENERIC) {
-            if (tud_suspended()) {
+        // Every changed report is queued, and then sent by the report
+        // scheduler, one per poll if the HID interface is shared.
+        if (report_dirty & DIRTY_KEYBOARD) {
+            hid_keyboard_queue();
+            report_dirty &= ~DIRTY_KEYBOARD;
+        }
+        if (report_dirty & DIRTY_MOUSE) {
+            hid_mouse_queue();
+            report_dirty &= ~DIRTY_MOUSE;
+        }
+        if ((report_dirty & DIRTY_GAMEPAD) && config_get_protocol() == PROTOCOL_GENERIC) {
+            hid_gamepad_queue();
+            report_dirty &= ~DIRTY_GAMEPAD;
+        }
+        hid_report_send_next();
+        if (config_get_protocol() != PROTOCOL_GENERIC) {
+            if ((report_dirty & DIRTY_GAMEPAD) && tud_suspended()) {
                 tud_remote_wakeup();
             }
+            // Built every tick (so axes going back to zero are sent too),
+            // unchanged reports are discarded by the XInput mailbox.
             hid_xinput_report();
-            priority_gamepad = 0;
+            report_dirty &= ~DIRTY_GAMEPAD;
         }
         // Gamepad values being reset so potentially unsent values are not
         // aggregated with the next cycle.
@@ -458,8 +627,7 @@ void hid_report() {
 }
 
 // A not-so-secret easter egg.
-void hid_thanks_(alarm_id_t alarm) {
-    cancel_alarm(alarm);
+void hid_thanks_() {
     static uint8_t x = 0;
     static bool p = 0;
     static uint8_t r;
@@ -479,14 +647,14 @@ void hid_thanks_(alarm_id_t alarm) {
         p = false;
         x += 1;
     }
-    add_alarm_in_ms(5, (alarm_callback_t)hid_thanks_, NULL, true);
+    wheel_add(&wheel, hid_now(), 5, HID_LATER_THANKS, NULL);
 }
 
 void hid_thanks() {
-    add_alarm_in_ms(5, (alarm_callback_t)hid_thanks_, NULL, true);
+    wheel_add(&wheel, hid_now(), 5, HID_LATER_THANKS, NULL);
 }
 
 void hid_init() {
     info("INIT: HID\n");
-    alarm_pool = alarm_pool_create(2, 255);
+    wheel_init(&wheel, hid_now());
 }
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <pico/stdlib.h>
 #include <hardware/gpio.h>
@@ -32,11 +33,37 @@ double offset_accel_1_x;
 double offset_accel_1_y;
 double offset_accel_1_z;
 
+// Last FIFO average of each IMU, held if no new samples are available.
+Vector imu_fifo_last[2] = {{0, 0, 0}, {0, 0, 0}};
+uint16_t imu_fifo_samples[2] = {0, 0};  // Gyro samples covered by the last read.
+
+// Asynchronous FIFO reads, one block is filled by DMA while the other one is
+// being processed.
+ImuAsyncBlock imu_async_blocks[2];
+uint8_t imu_async_back = 0;
+volatile uint8_t imu_async_step = IMU_ASYNC_DONE;
+int16_t imu_async_skip = -1;  // Older words still to be skipped, -1 if unknown.
+Vector imu_async_accel = {0, 0, 0};  // Accelerometer of the last processed block.
+
+// Online gyro bias estimation.
+ImuBias imu_bias = {0,};
+uint32_t imu_bias_persisted = 0;  // Milliseconds.
+uint32_t imu_bias_updates = 0;
+// Offsets handed from the estimation (core 1 in dual-core mode) to core 0.
+double imu_bias_offsets[6];
+volatile bool imu_bias_pending = false;
+
 void imu_init_single(uint8_t cs, uint8_t gyro_conf) {
     uint8_t id = bus_spi_read_one(cs, IMU_WHO_AM_I);
     bus_spi_write(cs, IMU_CTRL1_XL, IMU_CTRL1_XL_2G);
     bus_spi_write(cs, IMU_CTRL8_XL, IMU_CTRL8_XL_LP);
     bus_spi_write(cs, IMU_CTRL2_G, gyro_conf);
+    if (CFG_IMU_FIFO) {
+        bus_spi_write(cs, IMU_FIFO_CTRL1, CFG_IMU_FIFO_WATERMARK & BIT_8);
+        bus_spi_write(cs, IMU_FIFO_CTRL2, CFG_IMU_FIFO_WATERMARK >> 8);
+        bus_spi_write(cs, IMU_FIFO_CTRL3, IMU_FIFO_CTRL3_GYRO);
+        bus_spi_write(cs, IMU_FIFO_CTRL4, IMU_FIFO_CTRL4_CONTINUOUS);
+    }
     uint8_t xl = bus_spi_read_one(cs, IMU_CTRL1_XL);
     uint8_t g = bus_spi_read_one(cs, IMU_CTRL2_G);
     info("  IMU cs=%i id=0x%02x xl=0b%08i g=0b%08i\n", cs, id, bin(xl), bin(g));
@@ -50,6 +77,10 @@ void imu_init() {
     info("INIT: IMU\n");
     imu_init_single(PIN_SPI_CS0, IMU_CTRL2_G_500);
     imu_init_single(PIN_SPI_CS1, IMU_CTRL2_G_125);
+    imu_update_offsets();
+}
+
+void imu_update_offsets() {
     Config *config = config_read();
     offset_gyro_0_x = config->offset_gyro_0_x;
     offset_gyro_0_y = config->offset_gyro_0_y;
@@ -63,14 +94,27 @@ void imu_init() {
     offset_accel_1_x = config->offset_accel_1_x;
     offset_accel_1_y = config->offset_accel_1_y;
     offset_accel_1_z = config->offset_accel_1_z;
+    // Any estimation not yet consumed is older than these offsets.
+    imu_bias_pending = false;
 }
 
-Vector imu_read_gyro_bits(uint8_t cs) {
+// Decoding shared by the register and the FIFO reads, so both are consistent
+// with the calibration offsets.
+void imu_decode_gyro(uint8_t *buf, int16_t *x, int16_t *y, int16_t *z) {
+    *y =  (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
+    *z =  (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
+    *x = -(((int8_t)buf[5] << 8) + (int8_t)buf[4]);
+}
+
+void imu_read_gyro_raw(uint8_t cs, int16_t *x, int16_t *y, int16_t *z) {
     uint8_t buf[6];
     bus_spi_read(cs, IMU_OUTX_L_G, buf, 6);
-    int16_t y =  (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
-    int16_t z =  (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
-    int16_t x = -(((int8_t)buf[5] << 8) + (int8_t)buf[4]);
+    imu_decode_gyro(buf, x, y, z);
+}
+
+Vector imu_read_gyro_bits(uint8_t cs) {
+    int16_t x, y, z;
+    imu_read_gyro_raw(cs, &x, &y, &z);
     double offset_x = (cs==PIN_SPI_CS0) ? offset_gyro_0_x : offset_gyro_1_x;
     double offset_y = (cs==PIN_SPI_CS0) ? offset_gyro_0_y : offset_gyro_1_y;
     double offset_z = (cs==PIN_SPI_CS0) ? offset_gyro_0_z : offset_gyro_1_z;
@@ -81,51 +125,247 @@ Vector imu_read_gyro_bits(uint8_t cs) {
     };
 }
 
+void imu_decode_accel_raw(uint8_t *buf, int16_t *x, int16_t *y, int16_t *z) {
+    *x = (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
+    *y = (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
+    *z = (((int8_t)buf[5] << 8) + (int8_t)buf[4]);
+}
+
+Vector imu_decode_accel(uint8_t cs, uint8_t *buf) {
+    int16_t x, y, z;
+    imu_decode_accel_raw(buf, &x, &y, &z);
+    float offset_x = (cs==PIN_SPI_CS0) ? offset_accel_0_x : offset_accel_1_x;
+    float offset_y = (cs==PIN_SPI_CS0) ? offset_accel_0_y : offset_accel_1_y;
+    float offset_z = (cs==PIN_SPI_CS0) ? offset_accel_0_z : offset_accel_1_z;
+    return (Vector){
+        (float)x - offset_x,
+        (float)y - offset_y,
+        (float)z - offset_z,
+    };
+}
+
 Vector imu_read_accel_bits(uint8_t cs) {
     uint8_t buf[6];
     bus_spi_read(cs, IMU_OUTX_L_XL, buf, 6);
-    int16_t x =  (((int8_t)buf[1] << 8) + (int8_t)buf[0]);
-    int16_t y =  (((int8_t)buf[3] << 8) + (int8_t)buf[2]);
-    int16_t z =  (((int8_t)buf[5] << 8) + (int8_t)buf[4]);
-    double offset_x = (cs==PIN_SPI_CS0) ? offset_accel_0_x : offset_accel_1_x;
-    double offset_y = (cs==PIN_SPI_CS0) ? offset_accel_0_y : offset_accel_1_y;
-    double offset_z = (cs==PIN_SPI_CS0) ? offset_accel_0_z : offset_accel_1_z;
+    return imu_decode_accel(cs, buf);
+}
+
+// Gyro average of multiple reads. If ACCEL is provided, the last read also
+// includes the accelerometer (its registers follow the gyro ones), so both
+// come from the same transaction.
+Vector imu_read_gyro_burst(uint8_t cs, uint8_t samples, Vector *accel) {
+    // Samples are accumulated as integers, and the offset is applied only
+    // once to the average.
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t z = 0;
+    for(uint8_t i=0; i<samples; i++) {
+        int16_t sx, sy, sz;
+        if (accel && i == samples - 1) {
+            uint8_t buf[12];
+            bus_spi_read(cs, IMU_OUTX_L_G, buf, 12);
+            imu_decode_gyro(buf, &sx, &sy, &sz);
+            *accel = imu_decode_accel(cs, &buf[6]);
+        } else {
+            imu_read_gyro_raw(cs, &sx, &sy, &sz);
+        }
+        x += sx;
+        y += sy;
+        z += sz;
+    }
+    float offset_x = (cs==PIN_SPI_CS0) ? offset_gyro_0_x : offset_gyro_1_x;
+    float offset_y = (cs==PIN_SPI_CS0) ? offset_gyro_0_y : offset_gyro_1_y;
+    float offset_z = (cs==PIN_SPI_CS0) ? offset_gyro_0_z : offset_gyro_1_z;
     return (Vector){
-        (double)x - offset_x,
-        (double)y - offset_y,
-        (double)z - offset_z,
+        ((float)x / samples) - offset_x,
+        ((float)y / samples) - offset_y,
+        ((float)z / samples) - offset_z,
     };
 }
 
-Vector imu_read_gyro_burst(uint8_t cs, uint8_t samples) {
-    double x = 0;
-    double y = 0;
-    double z = 0;
-    for(uint8_t i=0; i<samples; i++) {
-        Vector sample = imu_read_gyro_bits(cs);
-        x += sample.x;
-        y += sample.y;
-        z += sample.z;
+// Number of unread words in the FIFO.
+uint16_t imu_fifo_words(uint8_t *status) {
+    return status[0] | ((status[1] & 0b11) << 8);
+}
+
+// Empty the FIFO, used when the backlog is too old to be worth reading.
+void imu_fifo_flush(uint8_t cs) {
+    bus_spi_write(cs, IMU_FIFO_CTRL4, IMU_FIFO_CTRL4_BYPASS);
+    bus_spi_write(cs, IMU_FIFO_CTRL4, IMU_FIFO_CTRL4_CONTINUOUS);
+}
+
+// Average of the gyro samples in BUF. If there was a backlog larger than what
+// is read per tick (eg: a slow tick) only the newest words are in BUF, but the
+// average is taken as representative of the whole BACKLOG, so the time covered
+// (and the rotation) is not lost.
+// A backlog longer than CFG_GYRO_DT_MAX means that the reads were not
+// continuous (eg: gyro engaged just now), the FIFO was flushed instead of read,
+// and it counts as one tick without rotation.
+Vector imu_fifo_average(uint8_t cs, uint8_t *buf, uint16_t words, uint16_t backlog) {
+    uint8_t index = (cs==PIN_SPI_CS0) ? 0 : 1;
+    if (backlog > IMU_FIFO_GAP) {
+        imu_fifo_samples[index] = CFG_IMU_FIFO_WATERMARK;
+        imu_fifo_last[index] = (Vector){0, 0, 0};
+        return imu_fifo_last[index];
+    }
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t z = 0;
+    uint16_t samples = 0;
+    for(uint16_t i=0; i<words; i++) {
+        uint8_t *word = &buf[i * IMU_FIFO_WORD];
+        if ((word[0] >> 3) != IMU_FIFO_TAG_GYRO) continue;
+        int16_t sx, sy, sz;
+        imu_decode_gyro(&word[1], &sx, &sy, &sz);
+        x += sx;
+        y += sy;
+        z += sz;
+        samples++;
+    }
+    imu_fifo_samples[index] = samples ? ((uint32_t)samples * backlog) / words : 0;
+    if (samples == 0) return imu_fifo_last[index];
+    float offset_x = (cs==PIN_SPI_CS0) ? offset_gyro_0_x : offset_gyro_1_x;
+    float offset_y = (cs==PIN_SPI_CS0) ? offset_gyro_0_y : offset_gyro_1_y;
+    float offset_z = (cs==PIN_SPI_CS0) ? offset_gyro_0_z : offset_gyro_1_z;
+    imu_fifo_last[index] = (Vector){
+        ((float)x / samples) - offset_x,
+        ((float)y / samples) - offset_y,
+        ((float)z / samples) - offset_z,
+    };
+    return imu_fifo_last[index];
+}
+
+// Average of all the gyro samples stored in the IMU FIFO since the previous
+// read, read in a single transaction (the FIFO output address wraps around
+// from the last data byte to the tag, so the words can be read in a row).
+// The FIFO can only be read oldest first, so the words beyond
+// IMU_FIFO_BURST are read and skipped.
+Vector imu_read_gyro_fifo(uint8_t cs) {
+    static uint8_t buf[IMU_FIFO_BURST * IMU_FIFO_WORD];
+    uint8_t status[2];
+    bus_spi_read(cs, IMU_FIFO_STATUS1, status, 2);
+    uint16_t backlog = imu_fifo_words(status);
+    if (backlog > IMU_FIFO_GAP) {
+        imu_fifo_flush(cs);
+        return imu_fifo_average(cs, buf, 0, backlog);
+    }
+    uint16_t words = min(backlog, IMU_FIFO_BURST);
+    uint16_t skip = backlog - words;
+    while(skip > 0) {
+        uint16_t chunk = min(skip, IMU_FIFO_BURST);
+        bus_spi_read(cs, IMU_FIFO_DATA_OUT_TAG, buf, chunk * IMU_FIFO_WORD);
+        skip -= chunk;
+    }
+    if (words > 0) bus_spi_read(cs, IMU_FIFO_DATA_OUT_TAG, buf, words * IMU_FIFO_WORD);
+    return imu_fifo_average(cs, buf, words, backlog);
+}
+
+// Executed from the DMA interrupt, starting the next transfer of the sequence
+// (FIFO status, older words to be skipped or a flush if any, and FIFO data, of
+// one IMU and then the other, and finally the accelerometer of both IMUs).
+void imu_async_next() {
+    ImuAsyncBlock *block = &imu_async_blocks[imu_async_back];
+    while(imu_async_step < IMU_ASYNC_DONE) {
+        uint8_t step = imu_async_step;
+        if (step >= IMU_ASYNC_ACCEL) {
+            imu_async_step++;
+            uint8_t index = step - IMU_ASYNC_ACCEL;
+            uint8_t cs = index ? PIN_SPI_CS1 : PIN_SPI_CS0;
+            bus_spi_read_async(cs, IMU_OUTX_L_XL, block->accel[index], 6, imu_async_next);
+            return;
+        }
+        uint8_t index = step >> 1;
+        uint8_t cs = index ? PIN_SPI_CS1 : PIN_SPI_CS0;
+        if (!(step & 1)) {
+            imu_async_step++;
+            imu_async_skip = -1;
+            bus_spi_read_async(cs, IMU_FIFO_STATUS1, block->status[index], 2, imu_async_next);
+            return;
+        }
+        if (imu_async_skip < 0) {
+            block->backlog[index] = imu_fifo_words(block->status[index]);
+            block->words[index] = min(block->backlog[index], IMU_FIFO_BURST);
+            imu_async_skip = block->backlog[index] - block->words[index];
+            if (block->backlog[index] > IMU_FIFO_GAP) {
+                imu_fifo_flush(cs);
+                block->words[index] = 0;
+                imu_async_skip = 0;
+            }
+        }
+        if (imu_async_skip > 0) {
+            uint16_t chunk = min(imu_async_skip, IMU_FIFO_BURST);
+            imu_async_skip -= chunk;
+            bus_spi_read_async(cs, IMU_FIFO_DATA_OUT_TAG, block->data[index], chunk * IMU_FIFO_WORD, imu_async_next);
+            return;
+        }
+        imu_async_step++;
+        if (block->words[index] == 0) continue;
+        uint16_t size = block->words[index] * IMU_FIFO_WORD;
+        bus_spi_read_async(cs, IMU_FIFO_DATA_OUT_TAG, block->data[index], size, imu_async_next);
+        return;
     }
-    x /= samples;
-    y /= samples;
-    z /= samples;
+}
+
+// Process the block transferred during the previous tick, and start the
+// transfer of the next one, so the SPI traffic runs in the background while
+// the rest of the tick is computed (at the cost of one tick of latency).
+// The accelerometer is part of the block, so no blocking read is needed (which
+// would have to wait for the whole asynchronous sequence).
+Vector imu_read_gyro_async(Vector *imu1, Vector *accel) {
+    bus_spi_wait();  // Normally completed long ago.
+    ImuAsyncBlock *block = &imu_async_blocks[imu_async_back];
+    imu_async_back = !imu_async_back;
+    imu_async_step = 0;
+    imu_async_next();
+    Vector accel0 = imu_decode_accel(PIN_SPI_CS0, block->accel[0]);
+    Vector accel1 = imu_decode_accel(PIN_SPI_CS1, block->accel[1]);
+    imu_async_accel = (Vector){
+        (accel0.x + accel1.x) / 2,
+        (accel0.y + accel1.y) / 2,
+        (accel0.z + accel1.z) / 2
+    };
+    *accel = imu_async_accel;
+    *imu1 = imu_fifo_average(PIN_SPI_CS1, block->data[1], block->words[1], block->backlog[1]);
+    return imu_fifo_average(PIN_SPI_CS0, block->data[0], block->words[0], block->backlog[0]);
+}
+
+// Blend of both IMUs, the high sensitivity one (CS1) is preferred unless it
+// is close to saturation.
+Vector imu_combine_gyro(Vector imu0, Vector imu1) {
+    float weight = max(fabsf(imu1.x), fabsf(imu1.y)) / 32768.0f;
+    float weight_0 = ramp_mid(weight, 0.2f);
+    float weight_1 = 1 - weight_0;
+    float x = (imu0.x * weight_0) + (imu1.x * weight_1 / 4);
+    float y = (imu0.y * weight_0) + (imu1.y * weight_1 / 4);
+    float z = (imu0.z * weight_0) + (imu1.z * weight_1 / 4);
     return (Vector){x, y, z};
 }
 
 Vector imu_read_gyro() {
-    Vector imu0 = imu_read_gyro_burst(PIN_SPI_CS0, CFG_IMU_TICK_SAMPLES/8*1);
-    Vector imu1 = imu_read_gyro_burst(PIN_SPI_CS1, CFG_IMU_TICK_SAMPLES/8*7);
-    double weight = max(abs(imu1.x), abs(imu1.y)) / 32768.0;
-    double weight_0 = ramp_mid(weight, 0.2);
-    double weight_1 = 1 - weight_0;
-    double x = (imu0.x * weight_0) + (imu1.x * weight_1 / 4);
-    double y = (imu0.y * weight_0) + (imu1.y * weight_1 / 4);
-    double z = (imu0.z * weight_0) + (imu1.z * weight_1 / 4);
-    return (Vector){x, y, z};
+    Vector imu0;
+    Vector imu1;
+    Vector accel;
+    Vector *accel_ptr = NULL;
+    if (IMU_ASYNC) {
+        imu0 = imu_read_gyro_async(&imu1, &accel);
+        if (CFG_IMU_BIAS) accel_ptr = &accel;
+    } else if (CFG_IMU_FIFO) {
+        imu0 = imu_read_gyro_fifo(PIN_SPI_CS0);
+        imu1 = imu_read_gyro_fifo(PIN_SPI_CS1);
+    } else {
+        // The accelerometer comes with the last gyro read, for the bias
+        // estimation.
+        if (CFG_IMU_BIAS) accel_ptr = &accel;
+        imu0 = imu_read_gyro_burst(PIN_SPI_CS0, CFG_IMU_TICK_SAMPLES/8*1, NULL);
+        imu1 = imu_read_gyro_burst(PIN_SPI_CS1, CFG_IMU_TICK_SAMPLES/8*7, accel_ptr);
+    }
+    imu_bias_update(imu0, imu1, accel_ptr);
+    return imu_combine_gyro(imu0, imu1);
 }
 
 Vector imu_read_accel() {
+    // Already read as part of the asynchronous sequence.
+    if (IMU_ASYNC) return imu_async_accel;
     Vector accel0 = imu_read_accel_bits(PIN_SPI_CS0);
     Vector accel1 = imu_read_accel_bits(PIN_SPI_CS1);
     return (Vector){
@@ -135,57 +375,200 @@ Vector imu_read_accel() {
     };
 }
 
-Vector imu_calibrate_single(uint8_t cs, bool mode, double* x, double* y, double* z) {
-    char *mode_str = mode ? "accel" : "gyro";
-    info("IMU: cs=%i calibrating %s...\n", cs, mode_str);
-    *x = 0;
-    *y = 0;
-    *z = 0;
-    double tx = 0;
-    double ty = 0;
-    double tz = 0;
-    uint32_t i = 0;
-    uint32_t samples = (
-        mode ?
-        CFG_CALIBRATION_SAMPLES_ACCEL :
-        CFG_CALIBRATION_SAMPLES_GYRO
-    );
-    while(i < samples) {
-        if (!(i % CFG_CALIBRATION_BLINK_FREQ)) led_show_cycle_step();
-        Vector sample = mode ? imu_read_accel_bits(cs) : imu_read_gyro_bits(cs);
-        tx += sample.x;
-        ty += sample.y;
-        tz += sample.z;
-        i++;
+// Gyro and accelerometer read together, sharing a timestamp. With register
+// reads the accelerometer comes with the last gyro read of each IMU (saving
+// one transaction per IMU), the FIFO only holds the gyro so it is read
+// separately (or as part of the asynchronous sequence).
+// The time covered by the gyro value is derived from the number of FIFO
+// samples (exact), or otherwise from the time between reads.
+ImuSample imu_read_sample() {
+    static uint32_t last = 0;
+    ImuSample sample;
+    if (CFG_IMU_FIFO) {
+        sample.gyro = imu_read_gyro();
+        sample.accel = imu_read_accel();
+        sample.timestamp = time_us_32();
+        sample.dt = (imu_fifo_samples[1] * 1000000) / IMU_FIFO_ODR;
+        return sample;
     }
-    *x = tx / samples;
-    *y = ty / samples;
-    *z = tz / samples;
-    // Assuming the resting state of the controller is having a vector of 1G
-    // pointing down. (Newton's fault for inventing the gravity /jk).
-    if (mode==1) *z -= BIT_14;
-    info("IMU: cs=%i %s calibration x=%f y=%f z=%f\n", cs, mode_str, *x, *y, *z);
-}
-
-void imu_calibrate() {
-    imu_calibrate_single(PIN_SPI_CS0, 0, &offset_gyro_0_x, &offset_gyro_0_y, &offset_gyro_0_z);
-    imu_calibrate_single(PIN_SPI_CS1, 0, &offset_gyro_1_x, &offset_gyro_1_y, &offset_gyro_1_z);
-    imu_calibrate_single(PIN_SPI_CS0, 1, &offset_accel_0_x, &offset_accel_0_y, &offset_accel_0_z);
-    imu_calibrate_single(PIN_SPI_CS1, 1, &offset_accel_1_x, &offset_accel_1_y, &offset_accel_1_z);
-    config_set_gyro_offset(
-        offset_gyro_0_x,
-        offset_gyro_0_y,
-        offset_gyro_0_z,
-        offset_gyro_1_x,
-        offset_gyro_1_y,
-        offset_gyro_1_z
+    Vector accel0;
+    Vector accel1;
+    Vector imu0 = imu_read_gyro_burst(PIN_SPI_CS0, CFG_IMU_TICK_SAMPLES/8*1, &accel0);
+    Vector imu1 = imu_read_gyro_burst(PIN_SPI_CS1, CFG_IMU_TICK_SAMPLES/8*7, &accel1);
+    sample.timestamp = time_us_32();
+    sample.dt = sample.timestamp - last;
+    // Reads were not continuous (eg: gyro engaged just now).
+    if (sample.dt > CFG_GYRO_DT_MAX) sample.dt = 1000000 / CFG_TICK_FREQUENCY;
+    last = sample.timestamp;
+    imu_bias_update(imu0, imu1, &accel1);
+    sample.gyro = imu_combine_gyro(imu0, imu1);
+    sample.accel = (Vector){
+        (accel0.x + accel1.x) / 2,
+        (accel0.y + accel1.y) / 2,
+        (accel0.z + accel1.z) / 2
+    };
+    return sample;
+}
+
+/*
+Online gyro bias estimation.
+
+The gyro residuals of each IMU (the values after the offsets are applied) and
+the accelerometer are accumulated over windows of CFG_IMU_BIAS_WINDOW
+microseconds (so the window is the same regardless of how often the IMUs are
+read). A gap between reads longer than CFG_GYRO_DT_MAX restarts the window.
+If both had a low variance during a window with enough reads, and the gyro
+residual is small, the controller is considered still and a portion of the
+residual is moved into the offsets. So the temperature drift is followed
+during long sessions without the blocking calibration.
+
+When the accelerometer is not read together with the gyro (FIFO), it is read
+every CFG_IMU_BIAS_ACCEL_INTERVAL microseconds.
+
+The estimation runs wherever the IMUs are read (core 1 in dual-core mode), but
+the config is owned by core 0, so the new offsets are only published there
+(imu_bias_offsets, imu_bias_pending) and handed to the config layer by
+imu_bias_sync from the main loop. Only when they moved noticeably, and at most
+once per CFG_IMU_BIAS_PERSIST_INTERVAL, to not wear the flash.
+*/
+
+static void imu_bias_accumulate(Vector *sum, Vector *sq, Vector v) {
+    sum->x += v.x;
+    sum->y += v.y;
+    sum->z += v.z;
+    sq->x += v.x * v.x;
+    sq->y += v.y * v.y;
+    sq->z += v.z * v.z;
+}
+
+static Vector imu_bias_mean(Vector sum, uint32_t n) {
+    return (Vector){sum.x / n, sum.y / n, sum.z / n};
+}
+
+static bool imu_bias_still(Vector sum, Vector sq, uint32_t n, float variance) {
+    Vector mean = imu_bias_mean(sum, n);
+    return (
+        (sq.x / n) - (mean.x * mean.x) < variance &&
+        (sq.y / n) - (mean.y * mean.y) < variance &&
+        (sq.z / n) - (mean.z * mean.z) < variance
     );
-    config_set_accel_offset(
-        offset_accel_0_x,
-        offset_accel_0_y,
-        offset_accel_0_z,
-        offset_accel_1_x,
-        offset_accel_1_y,
-        offset_accel_1_z
+}
+
+void imu_bias_reset() {
+    memset(&imu_bias, 0, sizeof(ImuBias));
+}
+
+// Publish the current offsets to core 0, unless the previous ones were not
+// consumed yet (they are older anyway, the next window will publish again).
+void imu_bias_publish() {
+    if (imu_bias_pending) return;
+    imu_bias_offsets[0] = offset_gyro_0_x;
+    imu_bias_offsets[1] = offset_gyro_0_y;
+    imu_bias_offsets[2] = offset_gyro_0_z;
+    imu_bias_offsets[3] = offset_gyro_1_x;
+    imu_bias_offsets[4] = offset_gyro_1_y;
+    imu_bias_offsets[5] = offset_gyro_1_z;
+    __atomic_store_n(&imu_bias_pending, true, __ATOMIC_RELEASE);
+}
+
+// Executed from the main loop (core 0).
+void imu_bias_sync() {
+    if (!__atomic_load_n(&imu_bias_pending, __ATOMIC_ACQUIRE)) return;
+    double *offsets = imu_bias_offsets;
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    bool persist = now - imu_bias_persisted >= CFG_IMU_BIAS_PERSIST_INTERVAL;
+    if (persist) {
+        Config *config = config_read();
+        double delta = max(
+            fabs(offsets[3] - config->offset_gyro_1_x),
+            max(
+                fabs(offsets[4] - config->offset_gyro_1_y),
+                fabs(offsets[5] - config->offset_gyro_1_z)
+            )
+        );
+        persist = delta >= CFG_IMU_BIAS_PERSIST_DELTA;
+    }
+    if (persist) {
+        imu_bias_persisted = now;
+        info("IMU: Bias persisted after %lu updates\n", imu_bias_updates);
+        // Written into NVM on the next config sync.
+        config_set_gyro_offset(
+            offsets[0],
+            offsets[1],
+            offsets[2],
+            offsets[3],
+            offsets[4],
+            offsets[5]
+        );
+    }
+    __atomic_store_n(&imu_bias_pending, false, __ATOMIC_RELEASE);
+}
+
+// Feed the gyro residuals of both IMUs from one read, and the accelerometer
+// if it was read at the same time (otherwise NULL).
+void imu_bias_update(Vector imu0, Vector imu1, Vector *accel) {
+    if (!CFG_IMU_BIAS) return;
+    ImuBias *bias = &imu_bias;
+    uint32_t now = time_us_32();
+    // Reads were not continuous (eg: gyro engaged just now), the window would
+    // not be representative of the whole period.
+    if (bias->samples > 0 && now - bias->last > CFG_GYRO_DT_MAX) imu_bias_reset();
+    bias->last = now;
+    if (bias->samples == 0) bias->start = now;
+    Vector accel_read;
+    if (!accel && (bias->samples == 0 || now - bias->accel_last >= CFG_IMU_BIAS_ACCEL_INTERVAL)) {
+        accel_read = imu_read_accel_bits(PIN_SPI_CS1);
+        accel = &accel_read;
+    }
+    if (accel) {
+        bias->accel_last = now;
+        if (bias->accel_samples == 0) bias->accel_ref = *accel;
+        Vector relative = vector_sub(*accel, bias->accel_ref);
+        imu_bias_accumulate(&bias->accel_sum, &bias->accel_sq, relative);
+        bias->accel_samples++;
+    }
+    imu_bias_accumulate(&bias->gyro_sum[0], &bias->gyro_sq[0], imu0);
+    imu_bias_accumulate(&bias->gyro_sum[1], &bias->gyro_sq[1], imu1);
+    bias->samples++;
+    if (now - bias->start < CFG_IMU_BIAS_WINDOW) return;
+    // Window completed.
+    uint32_t n = bias->samples;
+    Vector mean0 = imu_bias_mean(bias->gyro_sum[0], n);
+    Vector mean1 = imu_bias_mean(bias->gyro_sum[1], n);
+    float residual = max(fabsf(mean1.x), max(fabsf(mean1.y), fabsf(mean1.z)));
+    bool still = (
+        n >= CFG_IMU_BIAS_MIN_SAMPLES &&
+        residual < CFG_IMU_BIAS_GYRO_MEAN &&
+        bias->accel_samples > 1 &&
+        imu_bias_still(bias->accel_sum, bias->accel_sq, bias->accel_samples, CFG_IMU_BIAS_ACCEL_VARIANCE) &&
+        imu_bias_still(bias->gyro_sum[1], bias->gyro_sq[1], n, CFG_IMU_BIAS_GYRO_VARIANCE) &&
+        // IMU 0 is 4 times less sensitive.
+        imu_bias_still(bias->gyro_sum[0], bias->gyro_sq[0], n, CFG_IMU_BIAS_GYRO_VARIANCE / 16)
     );
+    imu_bias_reset();
+    if (!still) return;
+    offset_gyro_0_x += mean0.x * CFG_IMU_BIAS_RATE;
+    offset_gyro_0_y += mean0.y * CFG_IMU_BIAS_RATE;
+    offset_gyro_0_z += mean0.z * CFG_IMU_BIAS_RATE;
+    offset_gyro_1_x += mean1.x * CFG_IMU_BIAS_RATE;
+    offset_gyro_1_y += mean1.y * CFG_IMU_BIAS_RATE;
+    offset_gyro_1_z += mean1.z * CFG_IMU_BIAS_RATE;
+    imu_bias_updates++;
+    imu_bias_publish();
+}
+
+// Gyro and accelerometer without the offsets applied, in a single transaction
+// together with the status register (for the calibration). Returns the data
+// ready flags (IMU_STATUS_GDA and IMU_STATUS_XLDA), since the sensors can be
+// read faster than their output data rate and the values may be repeated.
+uint8_t imu_read_raw(uint8_t cs, Vector *gyro, Vector *accel) {
+    // Status, a reserved byte, temperature (2 bytes), gyro and accel.
+    uint8_t buf[16];
+    int16_t x, y, z;
+    bus_spi_read(cs, IMU_STATUS_REG, buf, 16);
+    imu_decode_gyro(&buf[4], &x, &y, &z);
+    *gyro = (Vector){x, y, z};
+    imu_decode_accel_raw(&buf[10], &x, &y, &z);
+    *accel = (Vector){x, y, z};
+    return buf[0];
 }
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Macro interpreter.
+
+A macro is the 28 bytes slot of a SECTION_MACRO_* profile section. If the
+first byte is MACRO_MAGIC the rest is bytecode (see MacroOp), each instruction
+is an opcode byte followed by its operands. Otherwise it is the original flat
+list of keys, that are pressed and released one after the other, every
+MACRO_LEGACY_DELAY milliseconds (starting after one delay, as before).
+
+Each of the macros has a runner (no allocation), that is stepped once per tick
+from the main loop, executing instructions until a wait or the end of the
+macro is reached. So the timing is tick precise and deterministic, and
+different macros run concurrently. Only one counted loop can be active at a
+time per macro. Any key still pressed when a macro ends is released.
+*/
+
+#include <string.h>
+#include "macro.h"
+#include "config.h"
+#include "hid.h"
+
+MacroRunner macro_runners[MACRO_SLOTS] = {0,};
+
+static uint16_t macro_ticks(uint16_t ms) {
+    return ((ms * CFG_TICK_FREQUENCY) + 999) / 1000;
+}
+
+static uint8_t macro_fetch(MacroRunner *runner) {
+    if (runner->pc >= MACRO_LEN) return MACRO_END;
+    return runner->code[runner->pc++];
+}
+
+static void macro_press(MacroRunner *runner, uint8_t key) {
+    runner->pressed[key >> 5] |= (1u << (key & 31));
+    hid_press(key);
+}
+
+static void macro_unpress(MacroRunner *runner, uint8_t key) {
+    // Only keys pressed by this macro, so keys held by buttons are kept.
+    if (!(runner->pressed[key >> 5] & (1u << (key & 31)))) return;
+    runner->pressed[key >> 5] &= ~(1u << (key & 31));
+    hid_release(key);
+}
+
+static void macro_end(MacroRunner *runner) {
+    runner->active = false;
+    for(uint8_t w=0; w<8; w++) {
+        while (runner->pressed[w]) {
+            uint8_t bit = __builtin_ctz(runner->pressed[w]);
+            runner->pressed[w] &= runner->pressed[w] - 1;
+            hid_release((w * 32) + bit);
+        }
+    }
+}
+
+// Returns false when the macro ended.
+static bool macro_step_legacy(MacroRunner *runner) {
+    uint8_t index = runner->pc >> 1;
+    if (index >= MACRO_LEN || runner->code[index] == 0) return false;
+    if (runner->pc & 1) macro_unpress(runner, runner->code[index]);
+    else macro_press(runner, runner->code[index]);
+    runner->pc++;
+    runner->wait = macro_ticks(MACRO_LEGACY_DELAY);
+    return true;
+}
+
+// Returns false when the macro ended.
+static bool macro_step(MacroRunner *runner) {
+    for(uint8_t i=0; i<MACRO_STEPS_MAX; i++) {
+        uint8_t op = macro_fetch(runner);
+        if (op == MACRO_END) return false;
+        else if (op == MACRO_PRESS) macro_press(runner, macro_fetch(runner));
+        else if (op == MACRO_RELEASE) macro_unpress(runner, macro_fetch(runner));
+        else if (op == MACRO_WAIT) {
+            runner->wait = macro_ticks(macro_fetch(runner));
+            return true;
+        }
+        else if (op == MACRO_REPEAT) {
+            uint8_t offset = macro_fetch(runner);
+            uint8_t times = macro_fetch(runner);
+            // Only backward jumps, and never into the magic byte.
+            if (offset < 1 || offset >= runner->pc - 3) return false;
+            if (times == 0) {
+                if (runner->held) runner->pc = offset;
+            } else {
+                if (runner->loop < 0) runner->loop = times;
+                if (runner->loop > 0) {
+                    runner->loop--;
+                    runner->pc = offset;
+                } else {
+                    runner->loop = -1;
+                }
+            }
+        }
+        else if (op == MACRO_WAIT_RELEASE) {
+            if (runner->held) {
+                runner->pc--;
+                return true;
+            }
+        }
+        else return false;  // Unknown instruction.
+        // The macro may have executed a procedure that reset the macros.
+        if (!runner->active) return false;
+    }
+    return true;  // Steps limit reached, resumed on the next tick.
+}
+
+void macro_start(uint8_t index, uint8_t *code) {
+    MacroRunner *runner = &macro_runners[index - 1];
+    if (runner->active) {
+        // Already running, but the trigger is held again.
+        runner->held = true;
+        return;
+    }
+    memset(runner, 0, sizeof(MacroRunner));
+    runner->code = code;
+    runner->legacy = code[0] != MACRO_MAGIC;
+    runner->pc = runner->legacy ? 0 : 1;
+    runner->loop = -1;
+    runner->held = true;
+    runner->active = true;
+    // Flat macros always started after one delay.
+    if (runner->legacy) runner->wait = macro_ticks(MACRO_LEGACY_DELAY);
+}
+
+void macro_release(uint8_t index) {
+    macro_runners[index - 1].held = false;
+}
+
+void macro_tick() {
+    for(uint8_t i=0; i<MACRO_SLOTS; i++) {
+        MacroRunner *runner = &macro_runners[i];
+        if (!runner->active) continue;
+        if (runner->wait > 1) {
+            runner->wait--;
+            continue;
+        }
+        runner->wait = 0;
+        bool running = runner->legacy ? macro_step_legacy(runner) : macro_step(runner);
+        if (!running && runner->active) macro_end(runner);
+    }
+}
+
+// Stop every macro without releasing their keys (the key state is being reset
+// anyway).
+void macro_reset() {
+    for(uint8_t i=0; i<MACRO_SLOTS; i++) {
+        macro_runners[i].active = false;
+    }
+}
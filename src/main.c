@@ -14,7 +14,12 @@
 #include "touch.h"
 #include "imu.h"
 #include "hid.h"
+#include "event.h"
+#include "sampler.h"
+#include "profiler.h"
+#include "tick.h"
 #include "uart.h"
+#include "xinput.h"
 #include "logging.h"
 #include "common.h"
 
@@ -46,44 +51,64 @@ void main_init() {
     // Init USB.
     tusb_init();
     wait_for_usb_init();
+    tick_init();
     // Init components.
     bus_init();
     hid_init();
     thumbstick_init();
     touch_init();
+    event_init();
     rotary_init();
     profile_init();
     imu_init();
+    sampler_init();
 }
 
 void main_loop() {
     info("INIT: Main loop\n");
-    int16_t i = 0;
+    uint32_t i = 0;
     logging_set_onloop(true);
     while (true) {
         i++;
         // Start timer.
         uint32_t tick_start = time_us_32();
+        // Sensor samples from core 1 (if enabled).
+        profiler_start(STAGE_SAMPLER);
+        sampler_update();
+        profiler_stop(STAGE_SAMPLER);
         // Config.
+        profiler_start(STAGE_CONFIG_SYNC);
+        imu_bias_sync();
         config_sync();
+        profiler_stop(STAGE_CONFIG_SYNC);
+        // Events from interrupt handlers.
+        event_drain();
         // Report.
         profile_report_active();
+        profiler_start(STAGE_HID_REPORT);
         hid_report();
+        profiler_stop(STAGE_HID_REPORT);
         // Tick interval control.
         uint32_t tick_completed = time_us_32() - tick_start;
-        uint16_t tick_interval = 1000000 / CFG_TICK_FREQUENCY;
-        int32_t tick_idle = tick_interval - (int32_t)tick_completed;
+        profiler_record(STAGE_TICK, tick_completed);
         // Listen to incoming UART messages.
         uart_listen_char(i);
         // Timing stats.
         if (logging_get_level() >= LOG_DEBUG) {
             static float average = 0;
             average = smooth(average, tick_completed, 100);
-            if (!(i % 2000)) debug("Loop: avg=%.0f (us)\n", average);
+            if (!(i % 2000)) {
+                debug("Loop: avg=%.0f (us)\n", average);
+                profiler_log(STAGE_TICK);
+                profiler_log(STAGE_REPORT_AGE);
+                hid_log_report_stats();
+                xinput_log_stats();
+                profiler_log(STAGE_EVENT_LATENCY);
+                event_log_stats();
+            }
         }
         // Idling control.
-        if (tick_idle > 0) sleep_us((uint32_t)tick_idle);
-        else info("+");
+        tick_idle(tick_start, tick_completed);
     }
 }
 
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Fixed point polar coordinates.
+
+The magnitude of a vector is an integer square root, and instead of computing
+angles (atan2) the direction is classified by comparing slopes: a vector is
+at least a given angle away from an axis if the ratio between its components
+is at least the tangent of that angle. The tangents are computed once (eg: at
+profile load), so the per-tick work is a couple of integer multiplications.
+
+This file does not depend on the Pico SDK, so it can be compiled on a host.
+*/
+
+#include <math.h>
+#include "polar.h"
+
+// Integer square root (rounded down), bit by bit.
+uint32_t polar_isqrt(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+// Components up to 32767 (Axis).
+uint32_t polar_magnitude(int32_t x, int32_t y) {
+    return polar_isqrt((uint32_t)(x * x) + (uint32_t)(y * y));
+}
+
+// Slope of an angle between 0 and 45 degrees.
+uint16_t polar_slope(float degrees) {
+    if (degrees <= 0) return 0;
+    if (degrees >= 45) return POLAR_SLOPE_45;
+    return tanf(degrees * (float)(M_PI / 180)) * POLAR_SLOPE_45 + 0.5f;
+}
+
+// True if the angle between the vector and the ADJACENT axis is at least the
+// angle of SLOPE (as returned by polar_slope).
+bool polar_angle_ge(int32_t opposite, int32_t adjacent, uint16_t slope) {
+    uint32_t o = opposite < 0 ? -opposite : opposite;
+    uint32_t a = adjacent < 0 ? -adjacent : adjacent;
+    return (o << POLAR_SLOPE_BITS) >= a * slope;
+}
@@ -10,6 +10,7 @@
 #include "bus.h"
 #include "glyph.h"
 #include "pin.h"
+#include "profiler.h"
 #include "hid.h"
 #include "led.h"
 #include "webusb.h"
@@ -29,7 +30,10 @@ Button home;
 
 void Profile__report(Profile *self) {
     if (!enabled_all) return;
+    profiler_start(STAGE_IO_CACHE);
     bus_i2c_io_cache_update();
+    profiler_stop(STAGE_IO_CACHE);
+    profiler_start(STAGE_BUTTONS);
     home.report(&home);
     if (enabled_abxy) {
         self->a.report(&self->a);
@@ -51,10 +55,19 @@ void Profile__report(Profile *self) {
     self->r2.report(&self->r2);
     self->l4.report(&self->l4);
     self->r4.report(&self->r4);
+    profiler_stop(STAGE_BUTTONS);
+    profiler_start(STAGE_DHAT);
     self->dhat.report(&self->dhat);
+    profiler_stop(STAGE_DHAT);
+    profiler_start(STAGE_ROTARY);
     self->rotary.report(&self->rotary);
+    profiler_stop(STAGE_ROTARY);
+    profiler_start(STAGE_THUMBSTICK);
     self->thumbstick.report(&self->thumbstick);
+    profiler_stop(STAGE_THUMBSTICK);
+    profiler_start(STAGE_GYRO);
     self->gyro.report(&self->gyro);
+    profiler_stop(STAGE_GYRO);
 }
 
 void Profile__reset(Profile *self) {
@@ -131,7 +144,9 @@ void Profile__load_from_config(Profile *self, CtrlProfile *profile) {
         ctrl_thumbtick.distance_mode,
         ctrl_thumbtick.deadzone_override,
         ctrl_thumbtick.deadzone / 100.0,
-        (int8_t)ctrl_thumbtick.overlap / 100.0
+        (int8_t)ctrl_thumbtick.overlap / 100.0,
+        ctrl_thumbtick.filter_cutoff / 10.0,
+        ctrl_thumbtick.filter_beta / 10.0
     );
     if (ctrl_thumbtick.mode == THUMBSTICK_MODE_4DIR) {
         self->thumbstick.config_4dir(
@@ -188,21 +203,24 @@ void Profile__load_from_config(Profile *self, CtrlProfile *profile) {
         (int8_t)ctrl_gyro_x.angle_min,
         (int8_t)ctrl_gyro_x.angle_max,
         ctrl_gyro_x.actions_neg,
-        ctrl_gyro_x.actions_pos
+        ctrl_gyro_x.actions_pos,
+        ctrl_gyro_x.curve
     );
     self->gyro.config_y(
         &(self->gyro),
         (int8_t)ctrl_gyro_y.angle_min,
         (int8_t)ctrl_gyro_y.angle_max,
         ctrl_gyro_y.actions_neg,
-        ctrl_gyro_y.actions_pos
+        ctrl_gyro_y.actions_pos,
+        ctrl_gyro_y.curve
     );
     self->gyro.config_z(
         &(self->gyro),
         (int8_t)ctrl_gyro_z.angle_min,
         (int8_t)ctrl_gyro_z.angle_max,
         ctrl_gyro_z.actions_neg,
-        ctrl_gyro_z.actions_pos
+        ctrl_gyro_z.actions_pos,
+        ctrl_gyro_z.curve
     );
 }
 
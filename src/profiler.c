@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Tick profiler.
+
+Each stage of the tick is timestamped with profiler_start / profiler_stop, and
+the elapsed microseconds are accumulated into a histogram per stage. Values
+that are not durations of a stage (eg: report age) can be added directly with
+profiler_record. Everything is executed from the main loop, values measured in
+interrupts have to be handed over (see tick_record_report_age), otherwise
+they could be recorded while the histograms are being read or reset.
+
+Histograms are kept in RAM and are always enabled (the overhead is a couple of
+timer reads per stage), summaries can be requested by the app with the Ctrl
+protocol STATS_GET message.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pico/stdlib.h>
+#include "profiler.h"
+#include "common.h"
+#include "logging.h"
+
+uint32_t profiler_histogram[STAGE_LAST][PROFILER_BUCKETS] = {0,};
+uint32_t profiler_count[STAGE_LAST] = {0,};
+uint64_t profiler_total[STAGE_LAST] = {0,};
+uint16_t profiler_min[STAGE_LAST] = {0,};
+uint16_t profiler_max[STAGE_LAST] = {0,};
+uint32_t profiler_timestamp[STAGE_LAST] = {0,};
+
+uint8_t profiler_bucket(uint32_t value) {
+    if (value < PROFILER_LINEAR) return value;
+    uint8_t exponent = 31 - __builtin_clz(value);
+    uint8_t sub = (value >> (exponent - 3)) & (PROFILER_SUB_BUCKETS - 1);
+    uint16_t bucket = PROFILER_LINEAR + ((exponent - 4) * PROFILER_SUB_BUCKETS) + sub;
+    return min(bucket, PROFILER_BUCKETS - 1);
+}
+
+// Lowest value that falls into the given bucket.
+uint32_t profiler_bucket_value(uint8_t bucket) {
+    if (bucket < PROFILER_LINEAR) return bucket;
+    uint8_t exponent = ((bucket - PROFILER_LINEAR) / PROFILER_SUB_BUCKETS) + 4;
+    uint8_t sub = (bucket - PROFILER_LINEAR) % PROFILER_SUB_BUCKETS;
+    return (PROFILER_SUB_BUCKETS + sub) << (exponent - 3);
+}
+
+void profiler_record(ProfilerStage stage, uint32_t value) {
+    uint16_t value_16 = min(value, BIT_16);
+    if (profiler_count[stage] == 0 || value_16 < profiler_min[stage]) {
+        profiler_min[stage] = value_16;
+    }
+    if (value_16 > profiler_max[stage]) profiler_max[stage] = value_16;
+    profiler_histogram[stage][profiler_bucket(value)]++;
+    profiler_total[stage] += value;
+    profiler_count[stage]++;
+}
+
+void profiler_start(ProfilerStage stage) {
+    profiler_timestamp[stage] = time_us_32();
+}
+
+void profiler_stop(ProfilerStage stage) {
+    profiler_record(stage, time_us_32() - profiler_timestamp[stage]);
+}
+
+void profiler_reset() {
+    memset(profiler_histogram, 0, sizeof(profiler_histogram));
+    memset(profiler_count, 0, sizeof(profiler_count));
+    memset(profiler_total, 0, sizeof(profiler_total));
+    memset(profiler_min, 0, sizeof(profiler_min));
+    memset(profiler_max, 0, sizeof(profiler_max));
+}
+
+// Percentiles are reported as the upper bound of the bucket they fall into.
+uint16_t profiler_percentile(ProfilerStage stage, uint16_t permille) {
+    uint32_t target = ((uint64_t)profiler_count[stage] * permille + 999) / 1000;
+    uint32_t accumulated = 0;
+    for(uint8_t i=0; i<PROFILER_BUCKETS; i++) {
+        accumulated += profiler_histogram[stage][i];
+        if (accumulated >= target) {
+            uint32_t upper = profiler_bucket_value(i + 1) - 1;
+            return min(upper, profiler_max[stage]);
+        }
+    }
+    return profiler_max[stage];
+}
+
+ProfilerSummary profiler_summary(ProfilerStage stage) {
+    ProfilerSummary summary = {0,};
+    if (stage < 1 || stage >= STAGE_LAST) return summary;
+    summary.count = profiler_count[stage];
+    if (summary.count == 0) return summary;
+    summary.min = profiler_min[stage];
+    summary.max = profiler_max[stage];
+    summary.avg = profiler_total[stage] / summary.count;
+    summary.p50 = profiler_percentile(stage, 500);
+    summary.p90 = profiler_percentile(stage, 900);
+    summary.p99 = profiler_percentile(stage, 990);
+    return summary;
+}
+
+void profiler_log(ProfilerStage stage) {
+    ProfilerSummary s = profiler_summary(stage);
+    debug(
+        "Stage %i: n=%lu min=%u avg=%u p50=%u p90=%u p99=%u max=%u (us)\n",
+        stage, s.count, s.min, s.avg, s.p50, s.p90, s.p99, s.max
+    );
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Lock-free single-producer single-consumer ring.
+
+Head and tail are free-running counters, the slot index is obtained by masking
+them with the ring size (so the size must be a power of 2). The producer only
+advances the head after the slot has been fully written, and the consumer only
+advances the tail after the slot has been fully read, the acquire / release
+ordering guarantees the other side never sees a partially written slot.
+
+This file does not depend on the Pico SDK, so it can be compiled on a host.
+*/
+
+#include <string.h>
+#include "ring.h"
+
+Ring Ring_(void *buffer, uint16_t slot_size, uint16_t slots) {
+    Ring ring;
+    ring.head = 0;
+    ring.tail = 0;
+    ring.buffer = buffer;
+    ring.slot_size = slot_size;
+    ring.slots = slots;
+    ring.dropped = 0;
+    return ring;
+}
+
+bool ring_push(Ring *ring, void *item) {
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ring->slots) {
+        // Full, the newest item is discarded.
+        ring->dropped++;
+        return false;
+    }
+    uint8_t *slot = ring->buffer + ((head & (ring->slots - 1)) * ring->slot_size);
+    memcpy(slot, item, ring->slot_size);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool ring_pop(Ring *ring, void *item) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;  // Empty.
+    uint8_t *slot = ring->buffer + ((tail & (ring->slots - 1)) * ring->slot_size);
+    memcpy(item, slot, ring->slot_size);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint16_t ring_len(Ring *ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+// Only to be used by the consumer.
+void ring_clear(Ring *ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+}
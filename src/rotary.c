@@ -12,6 +12,7 @@
 #include "button.h"
 #include "rotary.h"
 #include "hid.h"
+#include "event.h"
 #include "logging.h"
 
 void rotary_set_mode(uint8_t value) {
@@ -20,11 +21,17 @@ void rotary_set_mode(uint8_t value) {
     rotary->mode = value;
 }
 
+// Interrupt handler, the rotation is applied by the main loop, see event.c.
 void rotary_callback(uint gpio, uint32_t events) {
+    int8_t increment = gpio_get(PIN_ROTARY_A) ^ gpio_get(PIN_ROTARY_B) ? -1 : 1;
+    event_push(EVENT_ROTARY, increment);
+}
+
+void rotary_event(int8_t increment, uint32_t timestamp) {
     Profile* profile = profile_get_active(false);
     Rotary* rotary = &(profile->rotary);
-    rotary->timestamp = time_us_32();
-    rotary->increment = gpio_get(PIN_ROTARY_A) ^ gpio_get(PIN_ROTARY_B) ? -1 : 1;
+    rotary->timestamp = timestamp;
+    rotary->increment = increment;
     rotary->pending = true;
 }
 
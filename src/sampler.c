@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Sensor acquisition.
+
+In single-core mode the read functions query the hardware directly, so the
+sensors are sampled on demand while the profile is being reported.
+
+In dual-core mode (CFG_DUAL_CORE) core 1 owns the IMUs, the ADC and the touch
+sensor, it samples them continuously and publishes timestamped samples into a
+lock-free ring. Core 0 drains the ring once per tick (sampler_update) and the
+read functions return the aggregated values, so profile logic, HID and USB
+servicing never wait behind the SPI / ADC traffic.
+
+Any other code that needs raw access to these sensors while core 1 is running
+(eg: calibration) must pause the sampler first.
+*/
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include "config.h"
+#include "sampler.h"
+#include "ring.h"
+#include "imu.h"
+#include "thumbstick.h"
+#include "touch.h"
+#include "logging.h"
+
+SamplerSample sampler_buffer[SAMPLER_RING_SLOTS];
+Ring sampler_ring;
+volatile bool sampler_running = false;
+volatile bool sampler_paused = false;
+volatile bool sampler_paused_ack = false;
+
+// Aggregated values as seen by core 0.
+SamplerSample sampler_latest = {0,};
+uint32_t sampler_samples_per_tick = 0;
+
+void sampler_acquire(SamplerSample *sample) {
+    ImuSample imu = imu_read_sample();
+    sample->gyro = imu.gyro;
+    sample->accel = imu.accel;
+    sample->dt = imu.dt;
+    sample->thumbstick_x = thumbstick_adc_raw(1);
+    sample->thumbstick_y = thumbstick_adc_raw(0);
+    sample->touch_elapsed = touch_get_elapsed();
+    sample->timestamp = time_us_32();
+}
+
+// If the ring is full (core 0 fell behind) the sample is dropped, but the
+// motion it covered is carried into the next sample that is pushed, so the
+// gyro integrated by core 0 does not lose any rotation.
+void sampler_carry(SamplerSample *sample, Vector *carry_gyro, uint32_t *carry_dt) {
+    uint32_t dt = sample->dt + *carry_dt;
+    if (*carry_dt == 0 || dt == 0) return;
+    sample->gyro = (Vector){
+        ((sample->gyro.x * sample->dt) + carry_gyro->x) / dt,
+        ((sample->gyro.y * sample->dt) + carry_gyro->y) / dt,
+        ((sample->gyro.z * sample->dt) + carry_gyro->z) / dt,
+    };
+    sample->dt = dt;
+}
+
+void sampler_core1() {
+    // Allow core 0 to park this core while writing into flash.
+    multicore_lockout_victim_init();
+    Vector carry_gyro = {0, 0, 0};
+    uint32_t carry_dt = 0;
+    while(true) {
+        if (sampler_paused) {
+            sampler_paused_ack = true;
+            while(sampler_paused) tight_loop_contents();
+            sampler_paused_ack = false;
+            // The ring is cleared on resume, so is the carry.
+            carry_dt = 0;
+        }
+        SamplerSample sample;
+        sampler_acquire(&sample);
+        sampler_carry(&sample, &carry_gyro, &carry_dt);
+        if (ring_push(&sampler_ring, &sample)) {
+            carry_dt = 0;
+        } else {
+            carry_gyro = (Vector){
+                sample.gyro.x * sample.dt,
+                sample.gyro.y * sample.dt,
+                sample.gyro.z * sample.dt,
+            };
+            carry_dt = sample.dt;
+        }
+    }
+}
+
+void sampler_update() {
+    if (!sampler_running) return;
+    // Drain all samples published since the previous tick. Gyro is averaged
+    // over all of them (weighted by the time each one covers), while the rest
+    // of sensors just use the most recent.
+    SamplerSample sample;
+    Vector gyro = {0, 0, 0};
+    uint32_t dt = 0;
+    uint32_t n = 0;
+    while(ring_pop(&sampler_ring, &sample)) {
+        gyro.x += sample.gyro.x * sample.dt;
+        gyro.y += sample.gyro.y * sample.dt;
+        gyro.z += sample.gyro.z * sample.dt;
+        dt += sample.dt;
+        sampler_latest = sample;
+        n++;
+    }
+    // If the producer did not deliver anything new, the previous values are
+    // held, but cover no time.
+    if (dt > 0) sampler_latest.gyro = (Vector){gyro.x / dt, gyro.y / dt, gyro.z / dt};
+    sampler_latest.dt = dt;
+    sampler_samples_per_tick = n;
+}
+
+void sampler_pause() {
+    if (!sampler_running) return;
+    sampler_paused = true;
+    while(!sampler_paused_ack) tight_loop_contents();
+}
+
+void sampler_resume() {
+    if (!sampler_running) return;
+    sampler_paused = false;
+    while(sampler_paused_ack) tight_loop_contents();
+    // Discard samples acquired before the pause.
+    ring_clear(&sampler_ring);
+}
+
+bool sampler_is_running() {
+    return sampler_running;
+}
+
+Vector sampler_read_gyro() {
+    if (!sampler_running) return imu_read_gyro();
+    return sampler_latest.gyro;
+}
+
+Vector sampler_read_accel() {
+    if (!sampler_running) return imu_read_accel();
+    return sampler_latest.accel;
+}
+
+// Gyro and accelerometer from the same acquisition.
+ImuSample sampler_read_imu() {
+    if (!sampler_running) return imu_read_sample();
+    return (ImuSample){
+        sampler_latest.gyro,
+        sampler_latest.accel,
+        sampler_latest.timestamp,
+        sampler_latest.dt
+    };
+}
+
+uint16_t sampler_read_thumbstick_x() {
+    if (!sampler_running) return thumbstick_adc_raw(1);
+    return sampler_latest.thumbstick_x;
+}
+
+uint16_t sampler_read_thumbstick_y() {
+    if (!sampler_running) return thumbstick_adc_raw(0);
+    return sampler_latest.thumbstick_y;
+}
+
+uint32_t sampler_read_touch() {
+    if (!sampler_running) return touch_get_elapsed();
+    return sampler_latest.touch_elapsed;
+}
+
+void sampler_init() {
+    if (!CFG_DUAL_CORE) return;
+    info("INIT: Sampler (core 1)\n");
+    sampler_ring = Ring_(sampler_buffer, sizeof(SamplerSample), SAMPLER_RING_SLOTS);
+    // Prime the values so the first tick does not see empty data.
+    sampler_acquire(&sampler_latest);
+    sampler_running = true;
+    multicore_launch_core1(sampler_core1);
+}
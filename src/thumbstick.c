@@ -6,6 +6,7 @@
 #include <string.h>
 #include <pico/stdlib.h>
 #include <hardware/adc.h>
+#include <hardware/dma.h>
 #include "config.h"
 #include "pin.h"
 #include "button.h"
@@ -13,7 +14,9 @@
 #include "common.h"
 #include "hid.h"
 #include "led.h"
+#include "polar.h"
 #include "profile.h"
+#include "sampler.h"
 #include "logging.h"
 #include "webusb.h"
 
@@ -28,13 +31,116 @@ Button daisy_b;
 Button daisy_x;
 Button daisy_y;
 
-float thumbstick_adc(uint8_t adc_index, float offset) {
+// Free-running ADC.
+// Both axes are converted in turn (round robin) continuously, and each
+// conversion is copied by DMA into a ring, so the even indexes hold the input 0
+// and the odd indexes the input 1. Reads average the most recent samples of the
+// axis (oversampling), without waiting for any conversion or using the CPU in
+// between.
+uint16_t thumbstick_adc_ring[THUMBSTICK_ADC_RING] __attribute__((aligned(THUMBSTICK_ADC_RING * 2)));
+int thumbstick_adc_dma;
+float thumbstick_adc_smoothed[2] = {0, 0};
+
+void thumbstick_adc_dma_stop() {
+    adc_run(false);
+    dma_channel_abort(thumbstick_adc_dma);
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_fifo_drain();
+}
+
+void thumbstick_adc_dma_start() {
+    thumbstick_adc_dma_stop();
+    adc_set_round_robin(0b00011);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_select_input(0);  // Round robin starts on the input 0, in an even index.
+    dma_channel_set_write_addr(thumbstick_adc_dma, thumbstick_adc_ring, false);
+    dma_channel_set_trans_count(thumbstick_adc_dma, 0xFFFFFFFF, true);
+    adc_run(true);
+}
+
+void thumbstick_adc_dma_init() {
+    adc_set_clkdiv((48000000.0f / CFG_THUMBSTICK_ADC_RATE) - 1);
+    thumbstick_adc_dma = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(thumbstick_adc_dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, THUMBSTICK_ADC_RING_BITS);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(
+        thumbstick_adc_dma,
+        &config,
+        thumbstick_adc_ring,
+        &adc_hw->fifo,
+        0,
+        false
+    );
+    thumbstick_adc_dma_start();
+}
+
+uint16_t thumbstick_adc_oversampled(uint8_t adc_index) {
+    // Restart if the transfer count was ever exhausted (after more than a day).
+    if (!dma_channel_is_busy(thumbstick_adc_dma)) thumbstick_adc_dma_start();
+    uintptr_t write = dma_channel_hw_addr(thumbstick_adc_dma)->write_addr;
+    uint16_t index = (write - (uintptr_t)thumbstick_adc_ring) / 2;
+    // Most recent sample of this axis.
+    index = (index - 1) & (THUMBSTICK_ADC_RING - 1);
+    if ((index & 1) != adc_index) index = (index - 1) & (THUMBSTICK_ADC_RING - 1);
+    uint32_t sum[3] = {0, 0, 0};
+    for(uint8_t i=0; i<CFG_THUMBSTICK_ADC_OVERSAMPLE; i++) {
+        sum[i * 3 / CFG_THUMBSTICK_ADC_OVERSAMPLE] += thumbstick_adc_ring[index];
+        index = (index - 2) & (THUMBSTICK_ADC_RING - 1);
+    }
+    float value;
+    if (CFG_THUMBSTICK_ADC_MEDIAN) {
+        uint32_t a = sum[0];
+        uint32_t b = sum[1];
+        uint32_t c = sum[2];
+        uint32_t median = max(min(a, b), min(max(a, b), c));
+        value = (float)median / (CFG_THUMBSTICK_ADC_OVERSAMPLE / 3);
+    } else {
+        value = (float)(sum[0] + sum[1] + sum[2]) / CFG_THUMBSTICK_ADC_OVERSAMPLE;
+    }
+    if (CFG_THUMBSTICK_ADC_SMOOTH) {
+        float *smoothed = &thumbstick_adc_smoothed[adc_index];
+        if (*smoothed == 0) *smoothed = value;
+        *smoothed = smooth(*smoothed, value, CFG_THUMBSTICK_ADC_SMOOTH);
+        value = *smoothed;
+    }
+    return value + 0.5f;
+}
+
+uint16_t thumbstick_adc_single(uint8_t adc_index) {
     adc_select_input(adc_index);
-    float value = (float)adc_read() - BIT_11;
+    return adc_read();
+}
+
+uint16_t thumbstick_adc_raw(uint8_t adc_index) {
+    if (CFG_THUMBSTICK_ADC_DMA) return thumbstick_adc_oversampled(adc_index);
+    return thumbstick_adc_single(adc_index);
+}
+
+// Stop (or restart) the free-running ADC, so single conversions can be read
+// with thumbstick_adc_single. Calibration needs every sample to be a fresh and
+// unfiltered conversion, otherwise consecutive oversampled reads share most of
+// their window and are not independent.
+void thumbstick_adc_free_running(bool enabled) {
+    if (!CFG_THUMBSTICK_ADC_DMA) return;
+    if (enabled) thumbstick_adc_dma_start();
+    else thumbstick_adc_dma_stop();
+}
+
+float thumbstick_adc_normalize(uint16_t raw, float offset) {
+    float value = (float)raw - BIT_11;
     value = value / BIT_11 * CFG_THUMBSTICK_SATURATION;
     return constrain(value - offset, -1, 1);
 }
 
+float thumbstick_adc(uint8_t adc_index, float offset) {
+    return thumbstick_adc_normalize(thumbstick_adc_raw(adc_index), offset);
+}
+
 void thumbstick_update_deadzone() {
     uint8_t preset = config_get_deadzone_preset();
     config_deadzone = config_get_deadzone_value(preset);
@@ -46,27 +152,12 @@ void thumbstick_update_offsets() {
     offset_y = config->offset_ts_y;
 }
 
-void thumbstick_calibrate() {
-    info("Thumbstick: calibrating...\n");
-    float x = 0;
-    float y = 0;
-    for(uint32_t i=0; i<CFG_CALIBRATION_SAMPLES_THUMBSTICK; i++) {
-        if (!(i % CFG_CALIBRATION_BLINK_FREQ)) led_show_cycle_step();
-        x += thumbstick_adc(1, 0.0);
-        y += thumbstick_adc(0, 0.0);
-    }
-    x /= CFG_CALIBRATION_SAMPLES_THUMBSTICK;
-    y /= CFG_CALIBRATION_SAMPLES_THUMBSTICK;
-    info("Thumbstick: calibration x=%f y=%f\n", x, y);
-    config_set_thumbstick_offset(x, y);
-    thumbstick_update_offsets();
-}
-
 void thumbstick_init() {
     info("INIT: Thumbstick\n");
     adc_init();
     adc_gpio_init(PIN_TX);
     adc_gpio_init(PIN_TY);
+    if (CFG_THUMBSTICK_ADC_DMA) thumbstick_adc_dma_init();
     thumbstick_update_offsets();
     thumbstick_update_deadzone();
     // Alternative usage of ABXY while doing daisywheel.
@@ -77,7 +168,46 @@ void thumbstick_init() {
     daisy_y = Button_(PIN_Y, NORMAL, none, none);
 }
 
-void thumbstick_report_axis(uint8_t axis, float value) {
+// Adaptive low-pass filter (One-Euro).
+// The cutoff frequency rises with the speed of the stick: while it is held
+// still (or moved slowly) the cutoff stays at the minimum and the ADC jitter is
+// removed, and when it is moved fast the cutoff opens and the filter adds
+// almost no latency. Both axes share the same cutoff, so the direction of the
+// stick is not distorted. DT is provided by the caller (microseconds), so the
+// same filter can be replayed on recorded or synthetic traces.
+void thumbstick_filter_reset(ThumbstickFilter *filter) {
+    filter->primed = false;
+}
+
+static float thumbstick_filter_alpha(float cutoff, float dt) {
+    // Equivalent to 1 / (1 + tau/dt), with tau = 1 / (2*pi*cutoff).
+    float rate = 2 * (float)M_PI * cutoff * dt;
+    return rate / (rate + 1);
+}
+
+void thumbstick_filter(ThumbstickFilter *filter, float *x, float *y, uint32_t dt) {
+    if (filter->min_cutoff == 0) return;
+    if (!filter->primed || dt == 0 || dt > CFG_THUMBSTICK_FILTER_DT_MAX) {
+        filter->x = *x;
+        filter->y = *y;
+        filter->speed_x = 0;
+        filter->speed_y = 0;
+        filter->primed = true;
+        return;
+    }
+    float seconds = dt / 1000000.0f;
+    float alpha_speed = thumbstick_filter_alpha(CFG_THUMBSTICK_FILTER_SPEED_CUTOFF, seconds);
+    filter->speed_x += alpha_speed * (((*x - filter->x) / seconds) - filter->speed_x);
+    filter->speed_y += alpha_speed * (((*y - filter->y) / seconds) - filter->speed_y);
+    float speed = max(fabsf(filter->speed_x), fabsf(filter->speed_y));
+    float alpha = thumbstick_filter_alpha(filter->min_cutoff + (filter->beta * speed), seconds);
+    filter->x += alpha * (*x - filter->x);
+    filter->y += alpha * (*y - filter->y);
+    *x = filter->x;
+    *y = filter->y;
+}
+
+void thumbstick_report_axis(uint8_t axis, Axis value) {
     if      (axis == GAMEPAD_AXIS_LX)     hid_gamepad_lx(value);
     else if (axis == GAMEPAD_AXIS_LY)     hid_gamepad_ly(value);
     else if (axis == GAMEPAD_AXIS_RX)     hid_gamepad_rx(value);
@@ -90,17 +220,38 @@ void thumbstick_report_axis(uint8_t axis, float value) {
     else if (axis == GAMEPAD_AXIS_RZ)     hid_gamepad_rz(value);
 }
 
-uint8_t thumbstick_get_direction(float angle, float overlap) {
-    float a = 45 * (1 - overlap);
-    float b = 180 - a;
+// Directions overlap (eg: up and right at the same time) when the position
+// is within 45*overlap degrees of a diagonal, SLOPE being the slope of the
+// remaining 45*(1-overlap) degrees.
+uint8_t thumbstick_get_direction(ThumbstickPosition pos, uint16_t slope) {
     uint8_t mask = 0;
-    if (is_between(angle, -b, -a)) mask += DIR4_MASK_LEFT;
-    if (is_between(angle, a, b)) mask += DIR4_MASK_RIGHT;
-    if (fabs(angle) <= (90 - a)) mask += DIR4_MASK_UP;
-    if (fabs(angle) >= (90 + a)) mask += DIR4_MASK_DOWN;
+    bool horizontal = polar_angle_ge(pos.x, pos.y, slope);
+    bool vertical = polar_angle_ge(pos.y, pos.x, slope);
+    if (horizontal && pos.x <= 0) mask += DIR4_MASK_LEFT;
+    if (horizontal && pos.x >= 0) mask += DIR4_MASK_RIGHT;
+    if (vertical && pos.y <= 0) mask += DIR4_MASK_UP;
+    if (vertical && pos.y >= 0) mask += DIR4_MASK_DOWN;
     return mask;
 }
 
+Dir4 thumbstick_get_dir4(ThumbstickPosition pos) {
+    if (polar_angle_ge(pos.x, pos.y, POLAR_SLOPE_45)) {
+        return pos.x < 0 ? DIR4_LEFT : DIR4_RIGHT;
+    }
+    return pos.y < 0 ? DIR4_UP : DIR4_DOWN;
+}
+
+Dir8 thumbstick_get_dir8(ThumbstickPosition pos) {
+    if (!polar_angle_ge(pos.x, pos.y, POLAR_SLOPE_22_5)) {
+        return pos.y < 0 ? DIR8_UP : DIR8_DOWN;
+    }
+    if (!polar_angle_ge(pos.y, pos.x, POLAR_SLOPE_22_5)) {
+        return pos.x < 0 ? DIR8_LEFT : DIR8_RIGHT;
+    }
+    if (pos.y < 0) return pos.x < 0 ? DIR8_UP_LEFT : DIR8_UP_RIGHT;
+    else return pos.x < 0 ? DIR8_DOWN_LEFT : DIR8_DOWN_RIGHT;
+}
+
 // ============================================================================
 // Class.
 
@@ -128,10 +279,10 @@ void Thumbstick__report_axial(
     ThumbstickPosition pos
 ) {
     // Evaluate virtual buttons.
-    if (pos.radius > CFG_THUMBSTICK_ADDITIONAL_DEADZONE_FOR_BUTTONS) {
-        if (pos.radius < CFG_THUMBSTICK_INNER_RADIUS) self->inner.virtual_press = true;
+    if (pos.radius > axis_from_float(CFG_THUMBSTICK_ADDITIONAL_DEADZONE_FOR_BUTTONS)) {
+        if (pos.radius < axis_from_float(CFG_THUMBSTICK_INNER_RADIUS)) self->inner.virtual_press = true;
         else self->outer.virtual_press = true;
-        uint8_t direction = thumbstick_get_direction(pos.angle, self->overlap);
+        uint8_t direction = thumbstick_get_direction(pos, self->overlap_slope);
         if (direction & DIR4_MASK_LEFT)  self->left.virtual_press = true;
         if (direction & DIR4_MASK_RIGHT) self->right.virtual_press = true;
         if (direction & DIR4_MASK_UP)    self->up.virtual_press = true;
@@ -140,16 +291,16 @@ void Thumbstick__report_axial(
     // Report directional virtual buttons or axis.
     //// Left.
     if (!hid_is_axis(self->left.actions[0])) self->left.report(&self->left);
-    else thumbstick_report_axis(self->left.actions[0], -constrain(pos.x, -1, 0));
+    else thumbstick_report_axis(self->left.actions[0], -min(pos.x, 0));
     //// Right.
     if (!hid_is_axis(self->right.actions[0])) self->right.report(&self->right);
-    else thumbstick_report_axis(self->right.actions[0], constrain(pos.x, 0, 1));
+    else thumbstick_report_axis(self->right.actions[0], max(pos.x, 0));
     //// Up.
     if (!hid_is_axis(self->up.actions[0])) self->up.report(&self->up);
-    else thumbstick_report_axis(self->up.actions[0], -constrain(pos.y, -1, 0));
+    else thumbstick_report_axis(self->up.actions[0], -min(pos.y, 0));
     //// Down.
     if (!hid_is_axis(self->down.actions[0])) self->down.report(&self->down);
-    else thumbstick_report_axis(self->down.actions[0], constrain(pos.y, 0, 1));
+    else thumbstick_report_axis(self->down.actions[0], max(pos.y, 0));
     // Report inner and outer.
     self->inner.report(&self->inner);
     self->outer.report(&self->outer);
@@ -158,11 +309,12 @@ void Thumbstick__report_axial(
 }
 
 void Thumbstick__report_radial(Thumbstick *self, ThumbstickPosition pos) {
-    uint8_t direction = thumbstick_get_direction(pos.angle, self->overlap);
-    thumbstick_report_axis(self->left.actions[0],  (direction & DIR4_MASK_LEFT)  ? pos.radius : 0);
-    thumbstick_report_axis(self->right.actions[0], (direction & DIR4_MASK_RIGHT) ? pos.radius : 0);
-    thumbstick_report_axis(self->up.actions[0],    (direction & DIR4_MASK_UP)    ? pos.radius : 0);
-    thumbstick_report_axis(self->down.actions[0],  (direction & DIR4_MASK_DOWN)  ? pos.radius : 0);
+    uint8_t direction = thumbstick_get_direction(pos, self->overlap_slope);
+    Axis radius = pos.radius;
+    thumbstick_report_axis(self->left.actions[0],  (direction & DIR4_MASK_LEFT)  ? radius : 0);
+    thumbstick_report_axis(self->right.actions[0], (direction & DIR4_MASK_RIGHT) ? radius : 0);
+    thumbstick_report_axis(self->up.actions[0],    (direction & DIR4_MASK_UP)    ? radius : 0);
+    thumbstick_report_axis(self->down.actions[0],  (direction & DIR4_MASK_DOWN)  ? radius : 0);
     self->push.report(&self->push);
 }
 
@@ -226,27 +378,10 @@ void Thumbstick__report_daisywheel(Thumbstick *self, Dir8 dir) {
 void Thumbstick__report_alphanumeric(Thumbstick *self, ThumbstickPosition pos) {
     static Glyph input = {0};
     static uint8_t input_index = 0;
-    static float CUT4 = 45;
-    static float CUT4X = 135;  // 180-45
-    static float CUT8 = 22.5;
-    Dir4 dir4 = 0;
-    Dir8 dir8 = 0;
-    if (pos.radius > 0.7) {
+    if (pos.radius > axis_from_float(0.7)) {
         profile_enable_abxy(false);
-        // Detect direction 4.
-        if      (is_between(pos.angle, -CUT4X, -CUT4)) dir4 = DIR4_LEFT;
-        else if (is_between(pos.angle,  CUT4,  CUT4X)) dir4 = DIR4_RIGHT;
-        else if (fabs(pos.angle) <= 90 - CUT4)         dir4 = DIR4_UP;
-        else if (fabs(pos.angle) >= 90 + CUT4)         dir4 = DIR4_DOWN;
-        // Detect direction 8.
-        if      (is_between(pos.angle, -CUT8*1,  CUT8*1)) dir8 = DIR8_UP;
-        else if (is_between(pos.angle,  CUT8*1,  CUT8*3)) dir8 = DIR8_UP_RIGHT;
-        else if (is_between(pos.angle,  CUT8*3,  CUT8*5)) dir8 = DIR8_RIGHT;
-        else if (is_between(pos.angle,  CUT8*5,  CUT8*7)) dir8 = DIR8_DOWN_RIGHT;
-        else if (is_between(pos.angle, -CUT8*7, -CUT8*5)) dir8 = DIR8_DOWN_LEFT;
-        else if (is_between(pos.angle, -CUT8*5, -CUT8*3)) dir8 = DIR8_LEFT;
-        else if (is_between(pos.angle, -CUT8*3, -CUT8*1)) dir8 = DIR8_UP_LEFT;
-        else if (fabs(pos.angle) >= CUT8*7)               dir8 = DIR8_DOWN;
+        Dir4 dir4 = thumbstick_get_dir4(pos);
+        Dir8 dir8 = thumbstick_get_dir8(pos);
         // Record direction 4.
         if (input_index == 0 || dir4 != input[input_index-1]) {
             input[input_index] = dir4;
@@ -274,18 +409,26 @@ void Thumbstick__report(Thumbstick *self) {
     // Do not report if not calibrated.
     if (offset_x == 0 && offset_y == 0) return;
     // Get values from ADC.
-    float x = thumbstick_adc(1, offset_x);
-    float y = thumbstick_adc(0, offset_y);
+    float fx = thumbstick_adc_normalize(sampler_read_thumbstick_x(), offset_x);
+    float fy = thumbstick_adc_normalize(sampler_read_thumbstick_y(), offset_y);
+    // Filter.
+    uint32_t now = time_us_32();
+    thumbstick_filter(&self->filter, &fx, &fy, now - self->filter_timestamp);
+    self->filter_timestamp = now;
+    Axis x = axis_from_float(fx);
+    Axis y = axis_from_float(fy);
     // Get correct deadzone.
     float deadzone = self->deadzone_override ? self->deadzone : config_deadzone;
-    // Calculate trigonometry.
-    float angle = atan2(x, -y) * (180 / M_PI);
-    float radius = sqrt(powf(x, 2) + powf(y, 2));
-    radius = constrain(radius, 0, 1);
-    radius = ramp_low(radius, deadzone);
-    x = sin(radians(angle)) * radius;
-    y = -cos(radians(angle)) * radius;
-    ThumbstickPosition pos = {x, y, angle, radius};
+    // Polar coordinates, without angles. The deadzone is applied to the
+    // magnitude, and the cartesian values are scaled by the ratio between the
+    // new and the original magnitude, so the direction is kept.
+    uint32_t magnitude = polar_magnitude(x, y);
+    Axis radius = axis_ramp_low(min(magnitude, AXIS_MAX), axis_from_float(deadzone));
+    if (magnitude > 0) {
+        x = ((int32_t)x * radius) / (int32_t)magnitude;
+        y = ((int32_t)y * radius) / (int32_t)magnitude;
+    }
+    ThumbstickPosition pos = {x, y, radius};
     // Report.
     if (self->mode == THUMBSTICK_MODE_4DIR) {
         if (self->distance_mode == THUMBSTICK_DISTANCE_AXIAL) {
@@ -299,6 +442,7 @@ void Thumbstick__report(Thumbstick *self) {
 }
 
 void Thumbstick__reset(Thumbstick *self) {
+    thumbstick_filter_reset(&self->filter);
     if (self->mode == THUMBSTICK_MODE_4DIR) {
         self->left.reset(&self->left);
         self->right.reset(&self->right);
@@ -315,7 +459,9 @@ Thumbstick Thumbstick_ (
     ThumbstickDistance distance_mode,
     bool deadzone_override,
     float deadzone,
-    float overlap
+    float overlap,
+    float filter_cutoff,
+    float filter_beta
 ) {
     Thumbstick thumbstick;
     // Methods.
@@ -335,6 +481,11 @@ Thumbstick Thumbstick_ (
     thumbstick.deadzone_override = deadzone_override;
     thumbstick.deadzone = deadzone;
     thumbstick.overlap = overlap;
+    thumbstick.overlap_slope = polar_slope(45 * (1 - overlap));
+    thumbstick.filter.min_cutoff = filter_cutoff;
+    thumbstick.filter.beta = filter_beta;
+    thumbstick_filter_reset(&thumbstick.filter);
+    thumbstick.filter_timestamp = 0;
     thumbstick.glyphstick_index = 0;
     return thumbstick;
 }
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Tick scheduler.
+
+In free-running mode the main loop just idles whatever is left of the tick
+interval after doing its work, so the phase of the tick in relation to the
+moment the host polls the device is random.
+
+In SOF-synced mode (CFG_TICK_SOF_SYNC) the start of every tick is scheduled
+relative to the USB start-of-frame, so the work is completed (and the reports
+queued) CFG_TICK_SOF_MARGIN microseconds before the next frame, when the host
+is going to poll the endpoints. The duration of the work is estimated from the
+previous ticks with a slowly decaying peak.
+
+In both modes the age of the reports when the next frame starts is measured
+(see profiler STAGE_REPORT_AGE), so the latency of both approaches can be
+compared.
+*/
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <device/dcd.h>
+#include "config.h"
+#include "tick.h"
+#include "hid.h"
+#include "profiler.h"
+#include "common.h"
+#include "logging.h"
+
+volatile uint32_t tick_sof_timestamp = 0;
+volatile uint32_t tick_sof_frame = 0;
+volatile uint32_t tick_report_timestamp = 0;
+volatile bool tick_report_pending = false;
+volatile uint32_t tick_report_age = 0;
+volatile bool tick_report_age_ready = false;
+uint32_t tick_work_estimate = 0;
+bool tick_fallback_logged = false;
+
+// Called from the USB interrupt on every start-of-frame.
+void tick_sof(uint32_t frame) {
+    uint32_t now = time_us_32();
+    tick_sof_timestamp = now;
+    tick_sof_frame = frame;
+    if (tick_report_pending) {
+        tick_report_age = now - tick_report_timestamp;
+        tick_report_age_ready = true;
+        tick_report_pending = false;
+    }
+}
+
+// The report age is measured in the USB interrupt, but added to the profiler
+// from the main loop, since the main loop also reads and resets the profiler
+// histograms. The age is that of the oldest report queued since the previous
+// start-of-frame, and at most one is recorded per tick (a newer age replaces
+// one not recorded yet).
+void tick_record_report_age() {
+    if (!tick_report_age_ready) return;
+    uint32_t age = tick_report_age;
+    tick_report_age_ready = false;
+    profiler_record(STAGE_REPORT_AGE, age);
+}
+
+// Several reports can be queued before the next start-of-frame, only the
+// oldest one is timed.
+void tick_report_queued() {
+    if (tick_report_pending) return;
+    tick_report_timestamp = time_us_32();
+    tick_report_pending = true;
+}
+
+bool tick_is_synced() {
+    return (time_us_32() - tick_sof_timestamp) < TICK_SOF_TIMEOUT;
+}
+
+// Idle until the given time, meanwhile letting any queued HID reports be
+// delivered on the following polls.
+void tick_sleep_until(uint32_t target) {
+    while (true) {
+        int32_t remaining = (int32_t)(target - time_us_32());
+        if (remaining <= 0) return;
+        hid_report_drain();
+        sleep_us(min(remaining, TICK_DRAIN_SLICE));
+    }
+}
+
+void tick_idle_free(uint32_t tick_start, uint32_t tick_completed) {
+    uint16_t tick_interval = 1000000 / CFG_TICK_FREQUENCY;
+    int32_t tick_idle = tick_interval - (int32_t)tick_completed;
+    if (tick_idle > 0) tick_sleep_until(time_us_32() + tick_idle);
+    else info("+");
+}
+
+void tick_idle_sof(uint32_t tick_start, uint32_t tick_completed) {
+    uint32_t tick_interval = 1000000 / CFG_TICK_FREQUENCY;
+    // Peak of the work duration, decaying slowly so a single long tick does
+    // not delay the phase for too long.
+    tick_work_estimate -= tick_work_estimate / 64;
+    tick_work_estimate = max(tick_work_estimate, tick_completed);
+    uint32_t lead = min(tick_work_estimate + CFG_TICK_SOF_MARGIN, tick_interval);
+    // Earliest acceptable start for the next tick, allowing half a frame of
+    // jitter so the average rate is kept.
+    uint32_t earliest = tick_start + tick_interval - (TICK_FRAME_US / 2);
+    // First frame whose lead-in starts after that.
+    uint32_t sof = tick_sof_timestamp;
+    int32_t delta = (int32_t)(earliest - (sof - lead));
+    uint32_t frames = delta > 0 ? (delta + TICK_FRAME_US - 1) / TICK_FRAME_US : 0;
+    uint32_t next_start = sof - lead + (frames * TICK_FRAME_US);
+    int32_t tick_idle = (int32_t)(next_start - time_us_32());
+    if (tick_idle > 0) tick_sleep_until(next_start);
+    else if ((int32_t)tick_completed > (int32_t)tick_interval) info("+");
+}
+
+void tick_idle(uint32_t tick_start, uint32_t tick_completed) {
+    tick_record_report_age();
+    if (CFG_TICK_SOF_SYNC && tick_is_synced()) {
+        tick_idle_sof(tick_start, tick_completed);
+    } else {
+        if (CFG_TICK_SOF_SYNC && !tick_fallback_logged) {
+            warn("Tick: No SOF received, free-running\n");
+            tick_fallback_logged = true;
+        }
+        tick_idle_free(tick_start, tick_completed);
+    }
+}
+
+void tick_init() {
+    info("INIT: Tick scheduler (%s)\n", CFG_TICK_SOF_SYNC ? "SOF" : "free");
+    if (!CFG_TICK_SOF_SYNC) return;
+    // TinyUSB only enables the start-of-frame interrupt on demand. It has to be
+    // requested through the driver, since the driver interrupt handler masks
+    // the SOF interrupt again unless its own SOF flag is set.
+    dcd_sof_enable(0, true);
+}
@@ -7,6 +7,7 @@
 #include "config.h"
 #include "touch.h"
 #include "pin.h"
+#include "sampler.h"
 #include "common.h"
 #include "logging.h"
 
@@ -50,7 +51,7 @@ uint32_t touch_get_elapsed() {
 float touch_get_dynamic_threshold(uint8_t elapsed) {
     static float peak = 0;
     static uint8_t elapsed_prev = 0;
-    static uint16_t ticks = 0;
+    static uint32_t ticks = 0;
     ticks++;
     // Push down:
     // A periodic but slow decrease of the peak, to avoid ever-growing peaks
@@ -73,7 +74,7 @@ float touch_get_dynamic_threshold(uint8_t elapsed) {
 }
 
 bool touch_status() {
-    uint32_t elapsed = touch_get_elapsed();
+    uint32_t elapsed = sampler_read_touch();
     // Determine threshold.
     if (elapsed != 0) {
         threshold = (
@@ -86,7 +87,7 @@ bool touch_status() {
     }
     // Debug.
     if (loglevel >= 2) {
-        static uint16_t x = 0;
+        static uint32_t x = 0;
         x++;
         if (!(x % DEBUG_TOUCH_ELAPSED_FREQ)) {
             info("%i %.2f\n", elapsed, threshold);
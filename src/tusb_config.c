@@ -16,14 +16,80 @@ static const char *const descriptor_string[] = {
     STRING_XINPUT
 };
 
+#if USB_HID_SPLIT
+
+// Each device class on its own interface, so reports do not need report IDs.
+// WebUSB and XInput keep their interface numbers. The keyboard interface
+// supports the boot protocol (eg: BIOS), see hid_keyboard_nkro().
+
+uint8_t const descriptor_report_keyboard[] = {
+    DESCRIPTOR_REPORT_KEYBOARD(),
+};
+
+uint8_t const descriptor_report_mouse[] = {
+    TUD_HID_REPORT_DESC_MOUSE_CUSTOM(),
+};
+
+uint8_t const descriptor_report_gamepad[] = {
+    TUD_HID_REPORT_DESC_GAMEPAD_CUSTOM(),
+};
+
+uint8_t descriptor_configuration_generic[] = {
+    DESCRIPTOR_CONFIGURATION(4),
+    DESCRIPTOR_INTERFACE_HID_SPLIT(
+        ITF_HID,
+        ADDR_HID_IN,
+        sizeof(descriptor_report_keyboard),
+        HID_INTERVAL_KEYBOARD,
+        HID_ITF_PROTOCOL_KEYBOARD
+    ),
+    DESCRIPTOR_INTERFACE_WEBUSB,
+    DESCRIPTOR_INTERFACE_HID_SPLIT(
+        ITF_HID_MOUSE_GENERIC,
+        ADDR_HID_MOUSE_IN,
+        sizeof(descriptor_report_mouse),
+        HID_INTERVAL_MOUSE,
+        HID_ITF_PROTOCOL_NONE
+    ),
+    DESCRIPTOR_INTERFACE_HID_SPLIT(
+        ITF_HID_GAMEPAD_GENERIC,
+        ADDR_HID_GAMEPAD_IN,
+        sizeof(descriptor_report_gamepad),
+        HID_INTERVAL_GAMEPAD,
+        HID_ITF_PROTOCOL_NONE
+    ),
+};
+
+uint8_t descriptor_configuration_xinput[] = {
+    DESCRIPTOR_CONFIGURATION(4),
+    DESCRIPTOR_INTERFACE_HID_SPLIT(
+        ITF_HID,
+        ADDR_HID_IN,
+        sizeof(descriptor_report_keyboard),
+        HID_INTERVAL_KEYBOARD,
+        HID_ITF_PROTOCOL_KEYBOARD
+    ),
+    DESCRIPTOR_INTERFACE_WEBUSB,
+    DESCRIPTOR_INTERFACE_XINPUT,
+    DESCRIPTOR_INTERFACE_HID_SPLIT(
+        ITF_HID_MOUSE_XINPUT,
+        ADDR_HID_MOUSE_IN,
+        sizeof(descriptor_report_mouse),
+        HID_INTERVAL_MOUSE,
+        HID_ITF_PROTOCOL_NONE
+    ),
+};
+
+#else
+
 uint8_t const descriptor_report_generic[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
+    DESCRIPTOR_REPORT_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
     TUD_HID_REPORT_DESC_MOUSE_CUSTOM(HID_REPORT_ID(REPORT_MOUSE)),
     TUD_HID_REPORT_DESC_GAMEPAD_CUSTOM(HID_REPORT_ID(REPORT_GAMEPAD)),
 };
 
 uint8_t const descriptor_report_xinput[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
+    DESCRIPTOR_REPORT_KEYBOARD(HID_REPORT_ID(REPORT_KEYBOARD)),
     TUD_HID_REPORT_DESC_MOUSE_CUSTOM(HID_REPORT_ID(REPORT_MOUSE)),
 };
 
@@ -40,6 +106,8 @@ uint8_t descriptor_configuration_xinput[] = {
     DESCRIPTOR_INTERFACE_XINPUT
 };
 
+#endif
+
 uint8_t const *tud_descriptor_device_cb() {
     debug_uart("USB: tud_descriptor_device_cb\n");
     static tusb_desc_device_t descriptor_device = {DESCRIPTOR_DEVICE};
@@ -71,8 +139,14 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
 
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
     debug_uart("USB: tud_hid_descriptor_report_cb\n");
-    if (config_get_protocol() == PROTOCOL_GENERIC) return descriptor_report_generic;
-    else return descriptor_report_xinput;
+    #if USB_HID_SPLIT
+        if (instance == HID_INSTANCE_MOUSE) return descriptor_report_mouse;
+        if (instance == HID_INSTANCE_GAMEPAD) return descriptor_report_gamepad;
+        return descriptor_report_keyboard;
+    #else
+        if (config_get_protocol() == PROTOCOL_GENERIC) return descriptor_report_generic;
+        else return descriptor_report_xinput;
+    #endif
 }
 
 const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
@@ -5,6 +5,7 @@
 #include <pico/stdio.h>
 #include <pico/bootrom.h>
 #include <hardware/watchdog.h>
+#include "benchmark.h"
 #include "config.h"
 #include "self_test.h"
 #include "logging.h"
@@ -36,9 +37,13 @@ void uart_listen_char_do(bool limited) {
         info("UART: Self-test\n");
         self_test();
     }
+    if (input == 'P') {
+        info("UART: Benchmark\n");
+        benchmark();
+    }
 }
 
-void uart_listen_char(uint16_t loop_index) {
+void uart_listen_char(uint32_t loop_index) {
     if (loop_index % CFG_TICK_FREQUENCY) return;  // Execute only once per second.
     uart_listen_char_do(false);
 }
@@ -6,8 +6,8 @@
 
 Vector vector_normalize(Vector v) {
     float mag = (v.x*v.x) + (v.y*v.y) + (v.z*v.z);
-    if (fabs(mag - 1.0) > 0.0001) {  // Tolerance.
-        mag = sqrt(mag);
+    if (fabsf(mag - 1.0f) > 0.0001f) {  // Tolerance.
+        mag = sqrtf(mag);
         return (Vector){v.x/mag, v.y/mag, v.z/mag};
     }
     return v;
@@ -45,22 +45,19 @@ Vector vector_smooth(Vector a, Vector b, float weight) {
 }
 
 float vector_lenght(Vector v) {
-    return sqrt(
-        powf(fabs(v.x), 2) +
-        powf(fabs(v.y), 2) +
-        powf(fabs(v.z), 2)
-    );
+    return sqrtf((v.x*v.x) + (v.y*v.y) + (v.z*v.z));
 }
 
 Vector4 quaternion(Vector vector, float rotation /*radians*/) {
     // https://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles
     vector = vector_normalize(vector);
     float theta = rotation / 2;
+    float sin_theta = sinf(theta);
     return (Vector4){
-        vector.x * sin(theta),
-        vector.y * sin(theta),
-        vector.z * sin(theta),
-        cos(theta)
+        vector.x * sin_theta,
+        vector.y * sin_theta,
+        vector.z * sin_theta,
+        cosf(theta)
     };
 }
 
@@ -74,6 +71,30 @@ Vector4 qmultiply(Vector4 q1, Vector4 q2) {
     };
 }
 
+Vector4 qnormalize(Vector4 q) {
+    float mag = sqrtf((q.x*q.x) + (q.y*q.y) + (q.z*q.z) + (q.r*q.r));
+    return (Vector4){q.x/mag, q.y/mag, q.z/mag, q.r/mag};
+}
+
+// Quaternion that rotates the X, Y and Z axes into the given orthonormal axes.
+Vector4 qbasis(Vector x, Vector y, Vector z) {
+    // https://en.wikipedia.org/wiki/Rotation_matrix#Quaternion
+    float trace = x.x + y.y + z.z;
+    if (trace > 0) {
+        float s = sqrtf(trace + 1) * 2;
+        return (Vector4){(y.z - z.y) / s, (z.x - x.z) / s, (x.y - y.x) / s, s / 4};
+    } else if (x.x > y.y && x.x > z.z) {
+        float s = sqrtf(1 + x.x - y.y - z.z) * 2;
+        return (Vector4){s / 4, (y.x + x.y) / s, (z.x + x.z) / s, (y.z - z.y) / s};
+    } else if (y.y > z.z) {
+        float s = sqrtf(1 + y.y - x.x - z.z) * 2;
+        return (Vector4){(y.x + x.y) / s, s / 4, (z.y + y.z) / s, (z.x - x.z) / s};
+    } else {
+        float s = sqrtf(1 + z.z - x.x - y.y) * 2;
+        return (Vector4){(z.x + x.z) / s, (z.y + y.z) / s, s / 4, (x.y - y.x) / s};
+    }
+}
+
 Vector4 qconjugate(Vector4 q) {
     return (Vector4){-q.x, -q.y, -q.z, q.r};
 }
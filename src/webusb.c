@@ -10,6 +10,7 @@
 #include "config.h"
 #include "profile.h"
 #include "hid.h"
+#include "profiler.h"
 #include "tusb_config.h"
 #include "common.h"
 #include "logging.h"
@@ -22,6 +23,8 @@ bool webusb_timedout = false;
 uint8_t webusb_pending_config_share = 0;
 uint8_t webusb_pending_profile_share = 0;
 uint8_t webusb_pending_section_share = 0;
+uint8_t webusb_pending_stats_share = 0;
+bool webusb_pending_stats_reset = false;
 
 void webusb_flush_force() {
     uint16_t i = 0;
@@ -46,7 +49,8 @@ bool webusb_flush() {
         webusb_ptr_in == 0 &&
         !webusb_pending_config_share &&
         !webusb_pending_profile_share &&
-        !webusb_pending_section_share
+        !webusb_pending_section_share &&
+        !webusb_pending_stats_share
     ) {
         return true;
     }
@@ -69,6 +73,12 @@ bool webusb_flush() {
         ctrl = ctrl_profile_share(webusb_pending_profile_share, webusb_pending_section_share);
         webusb_pending_profile_share = 0;
         webusb_pending_section_share = 0;
+    } else if (webusb_pending_stats_share) {
+        ctrl = ctrl_stats_share(webusb_pending_stats_share);
+        webusb_pending_stats_share = 0;
+        // Reset only after the summary is generated, so no data is lost.
+        if (webusb_pending_stats_reset) profiler_reset();
+        webusb_pending_stats_reset = false;
     } else {
         uint8_t len = constrain(webusb_ptr_in-webusb_ptr_out, 0, CTRL_MAX_PAYLOAD_SIZE);
         uint8_t *offset_ptr = webusb_buffer + webusb_ptr_out;
@@ -123,6 +133,12 @@ void webusb_handle_profile_get(uint8_t profile, uint8_t section) {
     webusb_pending_section_share = section;
 }
 
+void webusb_handle_stats_get(uint8_t stage, bool reset) {
+    if (stage < 1 || stage >= STAGE_LAST) return;
+    webusb_pending_stats_share = stage;
+    webusb_pending_stats_reset = reset;
+}
+
 void webusb_handle_config_set(Ctrl_cfg_type key, uint8_t preset, uint8_t values[5]) {
     if (key > 4) return;
     webusb_pending_config_share = key;
@@ -194,6 +210,9 @@ void webusb_read() {
             &ctrl.payload[2]
         );
     }
+    if (ctrl.message_type == STATS_GET) {
+        webusb_handle_stats_get(ctrl.payload[0], ctrl.payload[1]);
+    }
 }
 
 void webusb_set_pending_config_share(bool value) {
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Hierarchical timing wheel for delayed actions (eg: delayed key releases and
+macros).
+
+Level 0 has one slot per millisecond for the next WHEEL_SLOTS milliseconds,
+level 1 has one slot per WHEEL_SLOTS milliseconds for the events further away.
+Every time level 0 completes a turn, the next slot of level 1 is cascaded into
+level 0. So adding an event and expiring it are both constant time, and the
+events come from a fixed pool (no allocation).
+
+The wheel is owned by a single context (the main loop), the callbacks are
+executed from wheel_advance(), never from an interrupt. The current time is
+provided by the caller, so it can be compiled and driven by a fake clock on a
+host.
+*/
+
+#include "wheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+static void wheel_append(Wheel *wheel, uint8_t level, uint8_t slot, uint16_t index) {
+    wheel->events[index].next = WHEEL_NONE;
+    if (wheel->head[level][slot] == WHEEL_NONE) wheel->head[level][slot] = index;
+    else wheel->events[wheel->tail[level][slot]].next = index;
+    wheel->tail[level][slot] = index;
+}
+
+static void wheel_insert(Wheel *wheel, uint16_t index) {
+    uint32_t due = wheel->events[index].due;
+    if (due - wheel->time < WHEEL_SLOTS) {
+        wheel_append(wheel, 0, due & WHEEL_MASK, index);
+    } else {
+        wheel_append(wheel, 1, (due >> WHEEL_SLOTS_BITS) & WHEEL_MASK, index);
+    }
+}
+
+static uint16_t wheel_detach(Wheel *wheel, uint8_t level, uint8_t slot) {
+    uint16_t index = wheel->head[level][slot];
+    wheel->head[level][slot] = WHEEL_NONE;
+    wheel->tail[level][slot] = WHEEL_NONE;
+    return index;
+}
+
+void wheel_clear(Wheel *wheel) {
+    for(uint8_t level=0; level<2; level++) {
+        for(uint8_t slot=0; slot<WHEEL_SLOTS; slot++) {
+            wheel_detach(wheel, level, slot);
+        }
+    }
+    for(uint16_t i=0; i<WHEEL_EVENTS; i++) {
+        wheel->events[i].next = (i == WHEEL_EVENTS - 1) ? WHEEL_NONE : i + 1;
+    }
+    wheel->free = 0;
+    wheel->available = WHEEL_EVENTS;
+}
+
+void wheel_init(Wheel *wheel, uint32_t now) {
+    wheel->time = now;
+    wheel->dropped = 0;
+    wheel_clear(wheel);
+}
+
+// Schedule an action to be executed DELAY milliseconds from NOW (at least 1
+// millisecond). NOW can be ahead of the wheel time, since the wheel is only
+// advanced once per tick, so the delays are not shortened by the time elapsed
+// since then.
+bool wheel_add(Wheel *wheel, uint32_t now, uint16_t delay, uint8_t action, void *arg) {
+    if (wheel->free == WHEEL_NONE) {
+        wheel->dropped++;
+        return false;
+    }
+    if (delay < 1) delay = 1;
+    if ((int32_t)(now - wheel->time) < 0) now = wheel->time;
+    uint32_t due = now + delay;
+    if (due - wheel->time > WHEEL_DELAY_MAX) due = wheel->time + WHEEL_DELAY_MAX;
+    uint16_t index = wheel->free;
+    WheelEvent *event = &wheel->events[index];
+    wheel->free = event->next;
+    wheel->available--;
+    event->due = due;
+    event->action = action;
+    event->arg = arg;
+    wheel_insert(wheel, index);
+    return true;
+}
+
+// Move the wheel time up to NOW (milliseconds), executing the expired events
+// in the order they were scheduled.
+void wheel_advance(Wheel *wheel, uint32_t now, WheelCallback callback) {
+    while ((int32_t)(now - wheel->time) > 0) {
+        wheel->time++;
+        uint32_t time = wheel->time;
+        if ((time & WHEEL_MASK) == 0) {
+            // Level 0 only holds events of this same turn, added less than
+            // WHEEL_SLOTS milliseconds ago, so after the cascaded ones. They
+            // are moved behind them to keep the order of equal due times.
+            uint16_t head[WHEEL_SLOTS];
+            uint16_t tail[WHEEL_SLOTS];
+            for(uint8_t slot=0; slot<WHEEL_SLOTS; slot++) {
+                tail[slot] = wheel->tail[0][slot];
+                head[slot] = wheel_detach(wheel, 0, slot);
+            }
+            uint8_t cascade = (time >> WHEEL_SLOTS_BITS) & WHEEL_MASK;
+            uint16_t index = wheel_detach(wheel, 1, cascade);
+            while (index != WHEEL_NONE) {
+                uint16_t next = wheel->events[index].next;
+                wheel_insert(wheel, index);
+                index = next;
+            }
+            for(uint8_t slot=0; slot<WHEEL_SLOTS; slot++) {
+                if (head[slot] == WHEEL_NONE) continue;
+                if (wheel->head[0][slot] == WHEEL_NONE) wheel->head[0][slot] = head[slot];
+                else wheel->events[wheel->tail[0][slot]].next = head[slot];
+                wheel->tail[0][slot] = tail[slot];
+            }
+        }
+        uint16_t index = wheel_detach(wheel, 0, time & WHEEL_MASK);
+        while (index != WHEEL_NONE) {
+            WheelEvent *event = &wheel->events[index];
+            uint16_t next = event->next;
+            uint8_t action = event->action;
+            void *arg = event->arg;
+            // Returned to the pool before the callback, so the callback can
+            // schedule new events.
+            event->next = wheel->free;
+            wheel->free = index;
+            wheel->available++;
+            callback(action, arg);
+            index = next;
+        }
+    }
+}
+
+uint16_t wheel_available(Wheel *wheel) {
+    return wheel->available;
+}
@@ -1,15 +1,43 @@
 // SPDX-License-Identifier: GPL-2.0-only
 // Copyright (C) 2022, Input Labs Oy.
 
+#include <string.h>
 #include <tusb.h>
 #include <device/usbd_pvt.h>
 #include "xinput.h"
 #include "tusb_config.h"
+#include "tick.h"
 #include "logging.h"
 
 const uint8_t ep_in[] = {DESCRIPTOR_ENDPOINT_XINPUT_IN};
 const uint8_t ep_out[] = {DESCRIPTOR_ENDPOINT_XINPUT_OUT};
 
+// Latest-value mailbox. Reports are written into the mailbox, and the mailbox
+// is sent as soon as the endpoint is free (either immediately or when the
+// previous transfer completes), so the host always gets the freshest state.
+xinput_report xinput_mailbox;
+xinput_report xinput_in_flight;  // Must outlive the transfer.
+bool xinput_in_flight_valid = false;  // Sent or being sent (not failed).
+bool xinput_mailbox_full = false;
+uint32_t xinput_dropped = 0;
+uint32_t xinput_superseded = 0;
+uint32_t xinput_deduplicated = 0;
+
+void xinput_mailbox_flush() {
+    if (!xinput_mailbox_full) return;
+    if (!tud_ready() || usbd_edpt_busy(0, ADDR_XINPUT_IN)) return;
+    if (!usbd_edpt_claim(0, ADDR_XINPUT_IN)) return;
+    xinput_in_flight = xinput_mailbox;
+    if (usbd_edpt_xfer(0, ADDR_XINPUT_IN, (uint8_t*)&xinput_in_flight, XINPUT_REPORT_SIZE)) {
+        xinput_mailbox_full = false;
+        xinput_in_flight_valid = true;
+    } else {
+        xinput_in_flight_valid = false;
+        xinput_dropped++;
+    }
+    usbd_edpt_release(0, ADDR_XINPUT_IN);
+}
+
 static void xinput_init(void) {}
 
 static void xinput_reset(uint8_t rhport) {}
@@ -52,17 +80,38 @@ static bool xinput_xfer_cb(
     xfer_result_t result,
     uint32_t xferred_bytes
 ) {
-    // printf("xinput_xfer_cb\n");
+    if (ep_addr == ADDR_XINPUT_IN) {
+        if (result != XFER_RESULT_SUCCESS) {
+            // The host did not get this state, so it is not valid for the
+            // deduplication anymore, and it is sent again unless a newer one
+            // is already waiting.
+            xinput_dropped++;
+            xinput_in_flight_valid = false;
+            if (!xinput_mailbox_full) {
+                xinput_mailbox = xinput_in_flight;
+                xinput_mailbox_full = true;
+            }
+        }
+        // Re-arm with whatever arrived while the endpoint was busy.
+        xinput_mailbox_flush();
+    }
     return true;
 }
 
+// Start-of-frame, called from the USB interrupt. This being the only app class
+// driver, it is also where the tick scheduler gets its SOF timing from,
+// regardless of the protocol in use.
+static void xinput_sof(uint8_t rhport, uint32_t frame_count) {
+    tick_sof(frame_count);
+}
+
 static usbd_class_driver_t const xinput_driver = {
     .init            = xinput_init,
     .reset           = xinput_reset,
     .open            = xinput_open,
     .control_xfer_cb = xinput_control_xfer_cb,
     .xfer_cb         = xinput_xfer_cb,
-    .sof             = NULL
+    .sof             = xinput_sof
 };
 
 usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count) {
@@ -70,12 +119,29 @@ usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count) {
     return &xinput_driver;
 }
 
-void xinput_send_report(xinput_report *report) {
-    if (!usbd_edpt_busy(0, ADDR_XINPUT_IN)) {
-        usbd_edpt_claim(0, ADDR_XINPUT_IN);
-        usbd_edpt_xfer(0, ADDR_XINPUT_IN, (uint8_t*)report, XINPUT_REPORT_SIZE);
-        usbd_edpt_release(0, ADDR_XINPUT_IN);
+// Returns false if the report was discarded for being identical to the last
+// one sent (or waiting to be sent).
+bool xinput_send_report(xinput_report *report) {
+    xinput_report *last = xinput_mailbox_full ? &xinput_mailbox : &xinput_in_flight;
+    bool valid = xinput_mailbox_full || xinput_in_flight_valid;
+    if (valid && !memcmp(report, last, XINPUT_REPORT_SIZE)) {
+        xinput_deduplicated++;
+        return false;
     }
+    if (xinput_mailbox_full) xinput_superseded++;
+    xinput_mailbox = *report;
+    xinput_mailbox_full = true;
+    xinput_mailbox_flush();
+    return true;
+}
+
+void xinput_log_stats() {
+    debug(
+        "XInput: dropped=%lu superseded=%lu deduplicated=%lu\n",
+        xinput_dropped,
+        xinput_superseded,
+        xinput_deduplicated
+    );
 }
 
 // void xinput_receive_report() {
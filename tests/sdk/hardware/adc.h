@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host declarations of the Pico SDK ADC functions, for the tests only.
+// They are not implemented, the tests must not reach them.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    volatile uint32_t fifo;
+} adc_hw_t;
+
+extern adc_hw_t *adc_hw;
+
+void adc_init();
+void adc_gpio_init(uint32_t gpio);
+void adc_select_input(uint32_t input);
+uint16_t adc_read();
+void adc_run(bool run);
+void adc_set_clkdiv(float clkdiv);
+void adc_set_round_robin(uint32_t input_mask);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_fifo_drain();
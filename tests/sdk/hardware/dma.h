@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host declarations of the Pico SDK DMA functions, for the tests only.
+// They are not implemented, the tests must not reach them.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DREQ_ADC 36
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+    volatile uint32_t read_addr;
+    volatile uint32_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint32_t channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_ring(dma_channel_config *c, bool write, uint32_t size_bits);
+void channel_config_set_dreq(dma_channel_config *c, uint32_t dreq);
+void dma_channel_configure(
+    uint32_t channel,
+    const dma_channel_config *config,
+    volatile void *write_addr,
+    const volatile void *read_addr,
+    uint32_t transfer_count,
+    bool trigger
+);
+dma_channel_hw_t *dma_channel_hw_addr(uint32_t channel);
+void dma_channel_abort(uint32_t channel);
+bool dma_channel_is_busy(uint32_t channel);
+void dma_channel_set_trans_count(uint32_t channel, uint32_t trans_count, bool trigger);
+void dma_channel_set_write_addr(uint32_t channel, volatile void *write_addr, bool trigger);
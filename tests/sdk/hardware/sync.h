@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host version of the Pico SDK interrupt masking, for the tests only.
+// Threads play the interrupt handlers, so disabling the interrupts is a
+// global lock that serializes them.
+
+#pragma once
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
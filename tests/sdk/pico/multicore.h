@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host version of the Pico SDK multicore functions, for the tests only.
+// Core 1 is a thread.
+
+#pragma once
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_lockout_victim_init();
@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host version of the Pico SDK basics, for the tests only.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sched.h>
+#include "pico/time.h"
+
+typedef unsigned int uint;
+
+// Busy waits give the other threads a chance to run on single CPU hosts.
+static inline void tight_loop_contents() {
+    sched_yield();
+}
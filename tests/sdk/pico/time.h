@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host version of the Pico SDK time functions, for the tests only.
+// The time is the host monotonic clock.
+
+#pragma once
+#include <stdint.h>
+
+typedef uint64_t absolute_time_t;
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+absolute_time_t get_absolute_time();
+uint32_t to_ms_since_boot(absolute_time_t time);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host implementation of the Pico SDK stand-ins in tests/sdk.
+
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <pthread.h>
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+uint64_t time_us_64() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+uint32_t time_us_32() {
+    return time_us_64();
+}
+
+absolute_time_t get_absolute_time() {
+    return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t time) {
+    return time / 1000;
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec duration = {us / 1000000, (us % 1000000) * 1000};
+    nanosleep(&duration, NULL);
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000);
+}
+
+pthread_t sdk_core1;
+
+void *sdk_core1_entry(void *entry) {
+    ((void (*)(void))entry)();
+    return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    pthread_create(&sdk_core1, NULL, sdk_core1_entry, (void*)entry);
+    pthread_detach(sdk_core1);
+}
+
+void multicore_lockout_victim_init() {}
+
+pthread_mutex_t sdk_interrupts = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t save_and_disable_interrupts() {
+    pthread_mutex_lock(&sdk_interrupts);
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {
+    pthread_mutex_unlock(&sdk_interrupts);
+}
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+// Host declarations of the TinyUSB device functions, for the tests only.
+// A test that reaches them has to provide them.
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "tusb_config.h"
+
+#define HID_PROTOCOL_BOOT 0
+
+void tud_task();
+bool tud_ready();
+bool tud_suspended();
+bool tud_remote_wakeup();
+bool tud_hid_ready();
+bool tud_hid_n_ready(uint8_t instance);
+uint8_t tud_hid_n_get_protocol(uint8_t instance);
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint16_t len);
+bool tud_hid_n_keyboard_report(uint8_t instance, uint8_t report_id, uint8_t modifier, uint8_t keycode[6]);
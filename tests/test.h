@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+#pragma once
+#include <stdio.h>
+
+// A failed check is reported and counted, but the test keeps running so all
+// the failures are shown at once. The test returns test_result() from main.
+
+static int test_failures = 0;
+
+#define check(condition, ...) do { \
+    if (!(condition)) { \
+        test_failures++; \
+        printf("FAIL %s:%i: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while(0)
+
+static inline int test_result(const char *name) {
+    if (test_failures) printf("%s: %i checks failed\n", name, test_failures);
+    else printf("%s: OK\n", name);
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The Q15 axis operations against the float pipeline they replaced.
+
+Every operation is swept over its input range and compared with the float
+formula (the ramp macros in common.h, and the conversions that were done when
+writing the HID report). The reported values must not differ by more than 2
+units, or 1 unit in the 8 bits trigger range. The ramps also scale the Q15
+rounding of their factor by their slope.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "common.h"
+#include "axis.h"
+
+#define AXIS_TOLERANCE 2
+
+// Float into the report range, as the HID report used to do it.
+int32_t report(float value) {
+    return (int16_t)(constrain(value, -1, 1) * BIT_15);
+}
+
+int32_t worst = 0;
+
+void compare(const char *name, int32_t fixed, int32_t reference, int32_t tolerance) {
+    int32_t error = abs(fixed - reference);
+    if (error > worst) worst = error;
+    check(
+        error <= tolerance,
+        "%s fixed=%i float=%i", name, fixed, reference
+    );
+}
+
+void test_conversions() {
+    for(int32_t i=-BIT_15; i<=BIT_15; i++) {
+        float value = (float)i / BIT_15;
+        Axis axis = axis_from_float(value);
+        compare("from_float", axis, report(value), AXIS_TOLERANCE);
+        compare("to_float", report(axis_to_float(axis)), i, AXIS_TOLERANCE);
+    }
+    compare("from_float above range", axis_from_float(1.5), BIT_15, 0);
+    compare("from_float below range", axis_from_float(-1.5), -BIT_15, 0);
+}
+
+void test_combine() {
+    srand(1);
+    for(uint32_t i=0; i<1000000; i++) {
+        float a = ((rand() / (float)RAND_MAX) * 4) - 2;
+        float b = ((rand() / (float)RAND_MAX) * 4) - 2;
+        float fa = constrain(a, -1, 1);
+        float fb = constrain(b, -1, 1);
+        Axis xa = axis_from_float(fa);
+        Axis xb = axis_from_float(fb);
+        compare("add", axis_add(xa, xb), report(fa + fb), AXIS_TOLERANCE);
+        compare("mul", axis_mul(xa, xb), report(fa * fb), AXIS_TOLERANCE);
+        compare("neg", axis_neg(xa), report(-fa), AXIS_TOLERANCE);
+        compare("abs", axis_abs(xa), report(fabsf(fa)), AXIS_TOLERANCE);
+    }
+    compare("neg min", axis_neg(AXIS_MIN), AXIS_MAX, 0);
+    compare("saturate high", axis_saturate(100000), AXIS_MAX, 0);
+    compare("saturate low", axis_saturate(-100000), AXIS_MIN, 0);
+}
+
+void test_ramps() {
+    // Deadzones from 0 to 0.45, as configurable in the profiles.
+    for(uint8_t percent=0; percent<=45; percent++) {
+        float k = percent / 100.0;
+        Axis xk = axis_from_float(k);
+        int32_t tolerance_low = AXIS_TOLERANCE + ceilf(1 / (1 - k));
+        int32_t tolerance_mid = AXIS_TOLERANCE + ceilf(1 / (1 - (2 * k)));
+        for(int32_t i=0; i<=BIT_15; i++) {
+            float value = (float)i / BIT_15;
+            Axis axis = axis_from_float(value);
+            // The threshold itself may fall on either side, as the deadzone
+            // is rounded into Q15.
+            if (abs(i - xk) <= 1 || abs(i - (BIT_15 - xk)) <= 1) continue;
+            compare("ramp_low", axis_ramp_low(axis, xk), report(ramp_low(value, k)), tolerance_low);
+            compare("ramp_mid", axis_ramp_mid(axis, xk), report(ramp_mid(value, k)), tolerance_mid);
+        }
+    }
+}
+
+void test_triggers() {
+    for(int32_t i=0; i<=BIT_15; i++) {
+        float value = (float)i / BIT_15;
+        Axis axis = axis_from_float(value);
+        int32_t reference_signed = (int16_t)(((value * 2) - 1) * BIT_15);
+        uint8_t reference = value * BIT_8;
+        compare("trigger_signed", axis_to_trigger_signed(axis), reference_signed, AXIS_TOLERANCE);
+        compare("trigger", axis_to_trigger(axis), reference, 1);
+    }
+    compare("trigger negative", axis_to_trigger(-1000), 0, 0);
+    compare("trigger_signed negative", axis_to_trigger_signed(-1000), -BIT_15, 0);
+}
+
+int main() {
+    test_conversions();
+    test_combine();
+    test_ramps();
+    test_triggers();
+    printf("worst error=%i units\n", worst);
+    return test_result("axis");
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The gyro mouse response curves compiled into lookup tables.
+
+The default curve (used by profiles with an all-zero curve) must follow the
+analytic hssnf(t=1, k=0.5) curve it replaced. Any curve must be continuous,
+including where the table ends, and symmetric. Curves with non-decreasing
+gains must also be monotonic.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "gyro.h"
+
+#define UNIT 65536  // 16.16 fixed point, in pixels per tick.
+#define SWEEP (4 * UNIT)
+#define DEFAULT_TOLERANCE 0.015  // Pixels.
+
+// As it was in common.h.
+double hssnf(double t, double k, double x) {
+    double a = x - (x * k);
+    double b = 1 - (x * k * (1/t));
+    return a / b;
+}
+
+double reference(double x) {
+    return x < 1 ? hssnf(1, 0.5, x) : x;
+}
+
+void test_default() {
+    GyroCurve curve;
+    uint8_t empty[GYRO_CURVE_POINTS] = {0,};
+    gyro_curve_compile(&curve, empty);
+    double worst = 0;
+    for(int32_t i=0; i<=SWEEP; i++) {
+        double output = (double)gyro_curve(&curve, i) / UNIT;
+        worst = fmax(worst, fabs(output - reference((double)i / UNIT)));
+    }
+    printf("default: worst error against hssnf=%.4f px\n", worst);
+    check(worst < DEFAULT_TOLERANCE, "default curve error %f px", worst);
+}
+
+void sweep(uint8_t *points, bool increasing) {
+    GyroCurve curve;
+    gyro_curve_compile(&curve, points);
+    // Largest change of the output for one unit of input, plus rounding. The
+    // output is input * gain, so its slope is the gain plus the input times
+    // the slope of the gain.
+    float gain_max = 0;
+    float gain_slope_max = 0;
+    for(uint8_t i=0; i<GYRO_CURVE_POINTS; i++) {
+        gain_max = fmaxf(gain_max, points[i] / 100.0f);
+        if (i == 0) continue;
+        float slope = abs(points[i] - points[i-1]) / 100.0f / GYRO_CURVE_STEP;
+        gain_slope_max = fmaxf(gain_slope_max, slope);
+    }
+    float input_max = (float)GYRO_CURVE_RANGE / UNIT;
+    int32_t step_max = ceilf(gain_max + (input_max * gain_slope_max)) + 2;
+    int32_t previous = gyro_curve(&curve, 0);
+    uint32_t jumps = 0;
+    uint32_t decreasing = 0;
+    uint32_t asymmetric = 0;
+    for(int32_t i=1; i<=SWEEP; i++) {
+        int32_t output = gyro_curve(&curve, i);
+        if (abs(output - previous) > step_max) jumps++;
+        if (output < previous) decreasing++;
+        if (gyro_curve(&curve, -i) != -output) asymmetric++;
+        previous = output;
+    }
+    check(jumps == 0, "%u discontinuities", jumps);
+    check(asymmetric == 0, "%u asymmetric outputs", asymmetric);
+    if (increasing) check(decreasing == 0, "%u decreasing outputs", decreasing);
+}
+
+void test_curves() {
+    uint8_t flat[GYRO_CURVE_POINTS] = {100, 100, 100, 100, 100, 100, 100, 100};
+    uint8_t steep[GYRO_CURVE_POINTS] = {1, 10, 40, 80, 120, 160, 200, 255};
+    uint8_t falling[GYRO_CURVE_POINTS] = {255, 200, 100, 50, 20, 10, 5, 1};
+    sweep(flat, true);
+    sweep(steep, true);
+    sweep(falling, false);
+    srand(1);
+    for(uint8_t n=0; n<50; n++) {
+        uint8_t points[GYRO_CURVE_POINTS];
+        uint8_t gain = 1 + (rand() % 50);
+        for(uint8_t i=0; i<GYRO_CURVE_POINTS; i++) {
+            points[i] = gain;
+            gain = fmin(255, gain + (rand() % 40));
+        }
+        sweep(points, true);
+        for(uint8_t i=0; i<GYRO_CURVE_POINTS; i++) points[i] = 1 + (rand() % 255);
+        sweep(points, false);
+    }
+    // The flat curve is the identity.
+    GyroCurve curve;
+    gyro_curve_compile(&curve, flat);
+    uint32_t mismatched = 0;
+    for(int32_t i=0; i<=SWEEP; i++) {
+        if (abs(gyro_curve(&curve, i) - i) > 1) mismatched++;
+    }
+    check(mismatched == 0, "flat curve differs from identity %u times", mismatched);
+}
+
+int main() {
+    test_default();
+    test_curves();
+    return test_result("curve");
+}
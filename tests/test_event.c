@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The event queue under concurrent producers.
+
+Several threads play interrupt handlers pushing rotary events at the same
+time, serialized by the host version of save_and_disable_interrupts, while
+the main thread drains them as the main loop does. Each producer remembers
+the events it managed to push, and each one must be delivered exactly once
+and in the order it was pushed. The events that could not be pushed must be
+the ones counted as dropped.
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "event.h"
+#include "ring.h"
+#include "profiler.h"
+
+#define PRODUCERS 4
+#define EVENTS 100000
+
+extern Ring event_ring;
+
+typedef struct Producer_struct {
+    uint8_t id;
+    uint32_t attempts;
+    uint32_t pushed;
+    uint8_t *sent;  // Sequence (modulo 32) of every event pushed.
+    uint32_t received;
+    uint8_t *delivered;
+    uint32_t last_timestamp;
+    uint32_t unordered;
+} Producer;
+
+Producer producers[PRODUCERS];
+volatile uint8_t producers_done = 0;
+uint32_t latencies = 0;
+
+void profiler_record(ProfilerStage stage, uint32_t value) {
+    if (stage == STAGE_EVENT_LATENCY) latencies++;
+}
+
+// Events are encoded as the producer id in the upper bits of the value, and
+// the sequence in the lower ones.
+void rotary_event(int8_t increment, uint32_t timestamp) {
+    Producer *producer = &producers[increment >> 5];
+    if (producer->received < EVENTS) {
+        producer->delivered[producer->received] = increment & 0b11111;
+    }
+    producer->received++;
+    if (timestamp < producer->last_timestamp) producer->unordered++;
+    producer->last_timestamp = timestamp;
+}
+
+void *producer_thread(void *arg) {
+    Producer *producer = arg;
+    for(uint32_t i=0; i<EVENTS; i++) {
+        uint8_t seq = i & 0b11111;
+        producer->attempts++;
+        if (event_push(EVENT_ROTARY, (producer->id << 5) | seq)) {
+            producer->sent[producer->pushed] = seq;
+            producer->pushed++;
+        }
+        // Let the other handlers and the main loop interleave.
+        if ((rand() & 0b111) == 0) sched_yield();
+    }
+    __atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main() {
+    event_init();
+    pthread_t threads[PRODUCERS];
+    for(uint8_t i=0; i<PRODUCERS; i++) {
+        producers[i] = (Producer){.id = i};
+        producers[i].sent = malloc(EVENTS);
+        producers[i].delivered = malloc(EVENTS);
+        pthread_create(&threads[i], NULL, producer_thread, &producers[i]);
+    }
+    while(true) {
+        bool done = __atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) == PRODUCERS;
+        event_drain();
+        if (done) break;
+        sched_yield();
+    }
+    for(uint8_t i=0; i<PRODUCERS; i++) pthread_join(threads[i], NULL);
+
+    uint32_t attempts = 0;
+    uint32_t received = 0;
+    for(uint8_t i=0; i<PRODUCERS; i++) {
+        Producer *producer = &producers[i];
+        printf(
+            "producer=%u attempts=%u pushed=%u received=%u\n",
+            i, producer->attempts, producer->pushed, producer->received
+        );
+        check(
+            producer->received == producer->pushed,
+            "producer %u pushed %u received %u", i, producer->pushed, producer->received
+        );
+        check(producer->unordered == 0, "producer %u timestamps out of order", i);
+        uint32_t mismatched = 0;
+        for(uint32_t j=0; j<producer->pushed && j<producer->received; j++) {
+            if (producer->sent[j] != producer->delivered[j]) mismatched++;
+        }
+        check(mismatched == 0, "producer %u %u events out of order", i, mismatched);
+        attempts += producer->attempts;
+        received += producer->received;
+    }
+    printf("dropped=%u\n", event_ring.dropped);
+    check(event_ring.dropped > 0, "the queue was never full");
+    check(
+        received + event_ring.dropped == attempts,
+        "received %u + dropped %u != %u", received, event_ring.dropped, attempts
+    );
+    check(latencies == received, "latency recorded %u times", latencies);
+    return test_result("event");
+}
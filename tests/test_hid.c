@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The key state bitset and the reports built from it, against the byte per key
+state matrix they replaced.
+
+Random presses and releases (with several buttons mapped to the same key) are
+applied both to the firmware and to a reference state matrix. The keyboard,
+mouse and gamepad reports must match the ones the former scans built from the
+matrix, and a report class must be marked dirty exactly when one of its keys
+flips. Finally both ways of building the reports are timed with a worst case
+set of pressed keys (the timing is reported, not checked).
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include "test.h"
+#include "hid.h"
+#include "tusb_config.h"
+
+#define ROUNDS 100000
+#define TIMED 1000000
+
+extern uint32_t state_bits[8];
+extern uint8_t state_count[256];
+extern uint8_t report_dirty;
+extern uint8_t keyboard_pending_modifier;
+extern uint8_t keyboard_pending_keys[6];
+extern hid_mouse_custom_report_t mouse_pending;
+extern hid_gamepad_custom_report_t gamepad_pending;
+void hid_keyboard_queue();
+void hid_mouse_queue();
+void hid_gamepad_queue();
+void hid_report_discard();
+bool hid_state_get(uint8_t key);
+
+uint8_t state_matrix[256];
+
+// Procedures, macros and profiles are not exercised by this test.
+void profile_set_home(bool state) {}
+void profile_set_home_gamepad(bool state) {}
+void profile_set_active(uint8_t index) {}
+uint8_t profile_get_active_index(bool strict) {return 0;}
+void config_tune(bool direction) {}
+void config_tune_set_mode(uint8_t mode) {}
+void config_calibrate() {}
+void config_reboot() {}
+void config_bootsel() {}
+void config_ignore_problems() {}
+void *config_profile_read(uint8_t index) {return NULL;}
+void rotary_set_mode(uint8_t mode) {}
+void macro_start(uint8_t index, uint8_t *sequence) {}
+void macro_release(uint8_t index) {}
+void gyro_wheel_antideadzone(int8_t increment) {}
+uint8_t tud_hid_n_get_protocol(uint8_t instance) {return 1;}
+
+// The former report scans, as they were in hid.c.
+
+void reference_keyboard(uint8_t *modifier, uint8_t *report) {
+    memset(report, 0, 6);
+    uint8_t keys_available = 6;
+    for(int i=0; i<=115; i++) {
+        if (state_matrix[i] >= 1) {
+            report[keys_available - 1] = (uint8_t)i;
+            keys_available--;
+            if (keys_available == 0) {
+                break;
+            }
+        }
+    }
+    *modifier = 0;
+    for(int i=0; i<8; i++) {
+        *modifier += !!state_matrix[MODIFIER_INDEX + i] << i;
+    }
+}
+
+uint8_t reference_mouse_buttons() {
+    uint8_t buttons = 0;
+    for(int i=0; i<5; i++) {
+        buttons += !!state_matrix[MOUSE_INDEX + i] << i;
+    }
+    return buttons;
+}
+
+uint32_t reference_gamepad_buttons() {
+    return (
+        (!!state_matrix[GAMEPAD_A]      <<  0) +
+        (!!state_matrix[GAMEPAD_B]      <<  1) +
+        (!!state_matrix[GAMEPAD_X]      <<  2) +
+        (!!state_matrix[GAMEPAD_Y]      <<  3) +
+        (!!state_matrix[GAMEPAD_L1]     <<  4) +
+        (!!state_matrix[GAMEPAD_R1]     <<  5) +
+        (!!state_matrix[GAMEPAD_L3]     <<  6) +
+        (!!state_matrix[GAMEPAD_R3]     <<  7) +
+        (!!state_matrix[GAMEPAD_LEFT]   <<  8) +
+        (!!state_matrix[GAMEPAD_RIGHT]  <<  9) +
+        (!!state_matrix[GAMEPAD_UP]     << 10) +
+        (!!state_matrix[GAMEPAD_DOWN]   << 11) +
+        (!!state_matrix[GAMEPAD_SELECT] << 12) +
+        (!!state_matrix[GAMEPAD_START]  << 13) +
+        (!!state_matrix[GAMEPAD_HOME]   << 14)
+    );
+}
+
+uint8_t key_class(uint8_t key) {
+    if (key >= GAMEPAD_INDEX) return DIRTY_GAMEPAD;
+    if (key >= MOUSE_INDEX) return DIRTY_MOUSE;
+    return DIRTY_KEYBOARD;
+}
+
+void reset() {
+    memset(state_bits, 0, 32);
+    memset(state_count, 0, 256);
+    memset(state_matrix, 0, 256);
+    mouse_pending = (hid_mouse_custom_report_t){0,};
+    report_dirty = 0;
+}
+
+// A few keys of each class, so they are pressed by several buttons at once.
+uint8_t random_key() {
+    uint8_t keys[] = {
+        4, 5, 6, 7, 8, 9, 10, 11, 30, 44, 57, 69, 89, 99, 104, 115,
+        KEY_CONTROL_LEFT, KEY_SHIFT_LEFT, KEY_ALT_RIGHT, KEY_SUPER_RIGHT,
+        MOUSE_1, MOUSE_2, MOUSE_3, MOUSE_5,
+        GAMEPAD_A, GAMEPAD_B, GAMEPAD_Y, GAMEPAD_L1, GAMEPAD_R3, GAMEPAD_LEFT,
+        GAMEPAD_UP, GAMEPAD_DOWN, GAMEPAD_SELECT, GAMEPAD_START, GAMEPAD_HOME,
+    };
+    return keys[rand() % sizeof(keys)];
+}
+
+void test_random() {
+    reset();
+    srand(1);
+    uint32_t wrong_dirty = 0;
+    uint32_t wrong_keyboard = 0;
+    uint32_t wrong_mouse = 0;
+    uint32_t wrong_gamepad = 0;
+    for(uint32_t i=0; i<ROUNDS; i++) {
+        uint8_t key = random_key();
+        bool press = rand() % 2;
+        bool was = state_matrix[key] > 0;
+        report_dirty = 0;
+        if (press) {
+            hid_press(key);
+            if (state_matrix[key] < 255) state_matrix[key]++;
+        } else {
+            hid_release(key);
+            if (state_matrix[key] > 0) state_matrix[key]--;
+        }
+        bool flipped = was != (state_matrix[key] > 0);
+        if (report_dirty != (flipped ? key_class(key) : 0)) wrong_dirty++;
+        hid_keyboard_queue();
+        hid_mouse_queue();
+        hid_gamepad_queue();
+        hid_report_discard();
+        uint8_t modifier;
+        uint8_t keys[6];
+        reference_keyboard(&modifier, keys);
+        if (modifier != keyboard_pending_modifier) wrong_keyboard++;
+        else if (memcmp(keys, keyboard_pending_keys, 6)) wrong_keyboard++;
+        if (mouse_pending.buttons != reference_mouse_buttons()) wrong_mouse++;
+        if (gamepad_pending.buttons != reference_gamepad_buttons()) wrong_gamepad++;
+    }
+    check(wrong_dirty == 0, "dirty classes wrong %u times", wrong_dirty);
+    check(wrong_keyboard == 0, "keyboard report wrong %u times", wrong_keyboard);
+    check(wrong_mouse == 0, "mouse buttons wrong %u times", wrong_mouse);
+    check(wrong_gamepad == 0, "gamepad buttons wrong %u times", wrong_gamepad);
+}
+
+// Scroll steps add up until the next mouse report, and releasing does nothing.
+void test_scroll() {
+    reset();
+    for(uint8_t i=0; i<3; i++) hid_press(MOUSE_SCROLL_UP);
+    hid_press(MOUSE_SCROLL_DOWN);
+    hid_release(MOUSE_SCROLL_UP);
+    check(report_dirty == DIRTY_MOUSE, "scroll dirty %u", report_dirty);
+    hid_mouse_queue();
+    hid_report_discard();
+    check(mouse_pending.scroll == 2, "scroll %i", mouse_pending.scroll);
+    check(!hid_state_get(MOUSE_SCROLL_UP), "scroll up still set");
+    check(state_count[MOUSE_SCROLL_UP] == 0, "scroll up count %u", state_count[MOUSE_SCROLL_UP]);
+}
+
+// Releasing a key that is not pressed does not underflow.
+void test_release() {
+    reset();
+    hid_release(KEY_A);
+    hid_press(KEY_A);
+    check(hid_state_get(KEY_A), "key not pressed after a stray release");
+    hid_release(KEY_A);
+    check(!hid_state_get(KEY_A), "key still pressed");
+}
+
+void test_timing() {
+    uint8_t keys[] = {
+        KEY_A, KEY_Z, KEY_SPACE, KEY_F12, KEY_PAD_9, KEY_F24,
+        KEY_CONTROL_LEFT, KEY_SHIFT_LEFT, KEY_ALT_LEFT, KEY_SUPER_LEFT,
+        KEY_CONTROL_RIGHT, KEY_SHIFT_RIGHT, KEY_ALT_RIGHT, KEY_SUPER_RIGHT,
+        MOUSE_1, MOUSE_2,
+    };
+    reset();
+    for(uint8_t i=0; i<sizeof(keys); i++) {
+        hid_press(keys[i]);
+        state_matrix[keys[i]]++;
+    }
+    for(uint8_t i=GAMEPAD_INDEX; i<=GAMEPAD_INDEX_END; i++) {
+        hid_press(i);
+        state_matrix[i]++;
+    }
+    volatile uint32_t sink = 0;
+    uint64_t start = time_us_64();
+    for(uint32_t i=0; i<TIMED; i++) {
+        hid_keyboard_queue();
+        hid_mouse_queue();
+        hid_gamepad_queue();
+        hid_report_discard();
+        sink += keyboard_pending_keys[0] + mouse_pending.buttons + gamepad_pending.buttons;
+    }
+    uint64_t bitset = time_us_64() - start;
+    start = time_us_64();
+    for(uint32_t i=0; i<TIMED; i++) {
+        uint8_t modifier;
+        uint8_t report[6];
+        reference_keyboard(&modifier, report);
+        sink += report[0] + modifier + reference_mouse_buttons() + reference_gamepad_buttons();
+    }
+    uint64_t matrix = time_us_64() - start;
+    printf(
+        "reports: bitset=%.1f ns (including queueing) matrix=%.1f ns per report set\n",
+        bitset * 1000.0 / TIMED,
+        matrix * 1000.0 / TIMED
+    );
+}
+
+int main() {
+    test_random();
+    test_scroll();
+    test_release();
+    test_timing();
+    return test_result("hid");
+}
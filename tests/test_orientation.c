@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Replay of synthetic IMU traces through the Mahony orientation filter.
+
+A true orientation is moved by known rotations, and the gyro and accel samples
+the controller would measure are generated from it, with a constant gyro bias
+added. The traces cover the controller resting, being accelerated (so the
+gravity feedback is skipped), rotating fast, and recovering from a tilt error.
+The tilt error is the angle between the estimated and the true up axis.
+*/
+
+#include <math.h>
+#include "test.h"
+#include "config.h"
+#include "common.h"
+#include "gyro.h"
+#include "vector.h"
+
+#define DT 4000  // Microseconds, 250Hz.
+#define RATE (1000000 / DT)
+
+extern Vector world_top;
+extern Vector4 orientation;
+extern Vector orientation_integral;
+void gyro_orientation_reset();
+bool gyro_orientation_init(Vector accel);
+void gyro_orientation_update(Vector gyro, Vector accel, uint32_t dt);
+
+Vector4 truth;
+Vector bias;  // Radians per second, in controller axes.
+
+Vector top_of(Vector4 q) {
+    return (Vector){
+        2 * (q.x*q.z + q.r*q.y),
+        2 * (q.y*q.z - q.r*q.x),
+        1 - 2 * (q.x*q.x + q.y*q.y)
+    };
+}
+
+float degrees_between(Vector a, Vector b) {
+    Vector cross = vector_cross_product(vector_normalize(a), vector_normalize(b));
+    float dot = (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+    return atan2f(vector_lenght(cross), dot) * 180 / M_PI;
+}
+
+float tilt_error() {
+    return degrees_between(world_top, top_of(truth));
+}
+
+// Rotates the true orientation by the given angular speed (radians per second,
+// in the same axes the filter uses), and feeds the filter with what the IMU
+// would measure over that step. The accel is gravity scaled by G.
+void step(Vector speed, float g) {
+    float seconds = DT / 1000000.0f;
+    Vector theta = {speed.x * seconds, speed.y * seconds, speed.z * seconds};
+    float angle = vector_lenght(theta);
+    if (angle > 0) truth = qnormalize(qmultiply(quaternion(theta, angle), truth));
+    // Inverse of the conversion in gyro_orientation_update.
+    float sens = ((float)DT / CFG_GYRO_DT_REFERENCE) / (-BIT_18 * (float)M_PI);
+    Vector measured = {
+        (theta.z + (bias.z * seconds)) / sens,
+        (theta.x + (bias.x * seconds)) / sens,
+        (theta.y + (bias.y * seconds)) / sens,
+    };
+    Vector top = top_of(truth);
+    Vector accel = {top.x * BIT_14 * g, top.y * BIT_14 * g, top.z * BIT_14 * g};
+    gyro_orientation_update(measured, accel, DT);
+}
+
+void start(Vector4 initial) {
+    truth = initial;
+    bias = (Vector){0, 0, 0};
+    gyro_orientation_reset();
+    Vector top = top_of(truth);
+    Vector accel = {top.x * BIT_14, top.y * BIT_14, top.z * BIT_14};
+    while(!gyro_orientation_init(accel));
+}
+
+void test_init() {
+    // Controller X axis pointing up (or down), where the initial forward axis
+    // can not be derived from the X axis.
+    Vector tops[] = {{1, 0, 0}, {-1, 0, 0}, {0, 0, 1}, {0.3, -0.5, 0.8}};
+    for(uint8_t i=0; i<4; i++) {
+        gyro_orientation_reset();
+        Vector accel = {tops[i].x * BIT_14, tops[i].y * BIT_14, tops[i].z * BIT_14};
+        while(!gyro_orientation_init(accel));
+        bool finite = isfinite(orientation.x) && isfinite(orientation.y) &&
+            isfinite(orientation.z) && isfinite(orientation.r);
+        check(finite, "init %u orientation is not finite", i);
+        float error = degrees_between(world_top, tops[i]);
+        check(error < 0.1, "init %u tilt error %f degrees", i, error);
+    }
+}
+
+// Resting with a gyro bias, the integral must absorb it so the tilt does not
+// drift. Then accelerated, the gravity feedback is skipped but the learned
+// bias is still compensated.
+void test_bias() {
+    start((Vector4){0, 0, 0, 1});
+    bias = (Vector){0.02, -0.015, 0.01};  // About 1 degree per second.
+    for(uint32_t i=0; i<120*RATE; i++) step((Vector){0, 0, 0}, 1);
+    float rest = tilt_error();
+    printf("bias: resting 120s tilt error=%.3f degrees\n", rest);
+    check(rest < 0.5, "resting tilt error %f degrees", rest);
+    for(uint32_t i=0; i<20*RATE; i++) step((Vector){0, 0, 0}, 1.5);
+    float accelerated = tilt_error();
+    printf("bias: accelerated 20s tilt error=%.3f degrees\n", accelerated);
+    check(accelerated < 1, "accelerated tilt error %f degrees", accelerated);
+}
+
+// Fast rotations are followed by the gyro alone, the feedback must not lag
+// behind them.
+void test_rotation() {
+    start((Vector4){0, 0, 0, 1});
+    float worst = 0;
+    for(uint32_t i=0; i<4*RATE; i++) {
+        float t = (float)i / RATE;
+        Vector speed = {3 * sinf(t * 2), 2 * cosf(t * 3), 4 * sinf(t)};
+        step(speed, 1);
+        worst = fmaxf(worst, tilt_error());
+    }
+    printf("rotation: worst tilt error=%.3f degrees\n", worst);
+    check(worst < 0.5, "rotation tilt error %f degrees", worst);
+}
+
+// Time until a 10 degrees tilt error is corrected to 1 degree.
+void test_recovery() {
+    start((Vector4){0, 0, 0, 1});
+    Vector4 offset = quaternion((Vector){1, 0, 0}, radians(10.0));
+    orientation = qnormalize(qmultiply(offset, orientation));
+    step((Vector){0, 0, 0}, 1);
+    float initial = tilt_error();
+    uint32_t steps = 0;
+    while(tilt_error() > 1 && steps < 120*RATE) {
+        step((Vector){0, 0, 0}, 1);
+        steps++;
+    }
+    float seconds = (float)steps / RATE;
+    printf("recovery: %.1f to 1 degrees in %.1fs\n", initial, seconds);
+    check(initial > 9, "initial tilt error %f degrees", initial);
+    check(seconds < 20, "recovery took %fs", seconds);
+}
+
+int main() {
+    test_init();
+    test_bias();
+    test_rotation();
+    test_recovery();
+    return test_result("orientation");
+}
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The integer polar functions, and the thumbstick direction sectors built on
+them, against the float versions they replaced.
+
+The square root is checked exactly, and the magnitude against hypot. The
+sectors (4 directions with overlap, dir4 and dir8) are compared with the
+former atan2 classification on a circle every 0.1 degrees, at several radii,
+skipping the positions within 0.1 degrees of a sector boundary, where the
+rounding of the slopes may fall on either side.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "common.h"
+#include "polar.h"
+#include "thumbstick.h"
+
+#define BOUNDARY_MARGIN 0.1  // Degrees.
+
+uint8_t thumbstick_get_direction(ThumbstickPosition pos, uint16_t slope);
+Dir4 thumbstick_get_dir4(ThumbstickPosition pos);
+Dir8 thumbstick_get_dir8(ThumbstickPosition pos);
+
+// As it was in thumbstick.c, ANGLE being 0 up and positive to the right.
+uint8_t reference_direction(float angle, float overlap) {
+    float a = 45 * (1 - overlap);
+    float b = 180 - a;
+    uint8_t mask = 0;
+    if (is_between(angle, -b, -a)) mask += DIR4_MASK_LEFT;
+    if (is_between(angle, a, b)) mask += DIR4_MASK_RIGHT;
+    if (fabs(angle) <= (90 - a)) mask += DIR4_MASK_UP;
+    if (fabs(angle) >= (90 + a)) mask += DIR4_MASK_DOWN;
+    return mask;
+}
+
+Dir4 reference_dir4(float angle) {
+    if (is_between(angle, -135, -45)) return DIR4_LEFT;
+    if (is_between(angle, 45, 135)) return DIR4_RIGHT;
+    if (fabs(angle) <= 45) return DIR4_UP;
+    return DIR4_DOWN;
+}
+
+Dir8 reference_dir8(float angle) {
+    float cut = 22.5;
+    if (is_between(angle, -cut*1, cut*1)) return DIR8_UP;
+    if (is_between(angle, cut*1, cut*3)) return DIR8_UP_RIGHT;
+    if (is_between(angle, cut*3, cut*5)) return DIR8_RIGHT;
+    if (is_between(angle, cut*5, cut*7)) return DIR8_DOWN_RIGHT;
+    if (is_between(angle, -cut*7, -cut*5)) return DIR8_DOWN_LEFT;
+    if (is_between(angle, -cut*5, -cut*3)) return DIR8_LEFT;
+    if (is_between(angle, -cut*3, -cut*1)) return DIR8_UP_LEFT;
+    return DIR8_DOWN;
+}
+
+// Distance in degrees to the closest multiple of STEP shifted by OFFSET.
+double boundary_distance(double angle, double step, double offset) {
+    double position = fmod(fabs(angle - offset), step);
+    return fmin(position, step - position);
+}
+
+void test_isqrt() {
+    uint32_t wrong = 0;
+    for(uint64_t i=0; i<(1 << 24); i++) {
+        uint32_t root = polar_isqrt(i);
+        if ((uint64_t)root * root > i || (uint64_t)(root + 1) * (root + 1) <= i) wrong++;
+    }
+    // The largest input polar_magnitude can produce.
+    uint32_t top = 2u * AXIS_MAX * AXIS_MAX;
+    uint32_t root = polar_isqrt(top);
+    if ((uint64_t)root * root > top || (uint64_t)(root + 1) * (root + 1) <= top) wrong++;
+    check(wrong == 0, "isqrt wrong %u times", wrong);
+}
+
+void test_magnitude() {
+    uint32_t worst = 0;
+    for(int32_t x=-AXIS_MAX; x<=AXIS_MAX; x+=97) {
+        for(int32_t y=-AXIS_MAX; y<=AXIS_MAX; y+=89) {
+            uint32_t reference = hypot(x, y);
+            uint32_t error = abs((int32_t)polar_magnitude(x, y) - (int32_t)reference);
+            if (error > worst) worst = error;
+        }
+    }
+    check(worst == 0, "magnitude error %u", worst);
+}
+
+void test_sectors() {
+    float overlaps[] = {0, 0.25, 0.5, 0.75, 1};
+    Axis radii[] = {3000, 16000, AXIS_MAX};
+    uint32_t compared = 0;
+    for(uint8_t r=0; r<3; r++) {
+        for(int32_t i=-1800; i<1800; i++) {
+            double angle = i / 10.0;
+            ThumbstickPosition pos = {
+                .x = sin(radians(angle)) * radii[r],
+                .y = -cos(radians(angle)) * radii[r],
+                .radius = radii[r],
+            };
+            if (boundary_distance(angle, 90, 45) > BOUNDARY_MARGIN) {
+                check(
+                    thumbstick_get_dir4(pos) == reference_dir4(angle),
+                    "dir4 at %.1f degrees", angle
+                );
+            }
+            if (boundary_distance(angle, 45, 22.5) > BOUNDARY_MARGIN) {
+                check(
+                    thumbstick_get_dir8(pos) == reference_dir8(angle),
+                    "dir8 at %.1f degrees", angle
+                );
+            }
+            for(uint8_t o=0; o<5; o++) {
+                float a = 45 * (1 - overlaps[o]);
+                if (boundary_distance(angle, 90, a) <= BOUNDARY_MARGIN) continue;
+                if (boundary_distance(angle, 90, -a) <= BOUNDARY_MARGIN) continue;
+                uint16_t slope = polar_slope(a);
+                check(
+                    thumbstick_get_direction(pos, slope) == reference_direction(angle, overlaps[o]),
+                    "direction at %.1f degrees, overlap %.2f", angle, overlaps[o]
+                );
+                compared++;
+            }
+        }
+    }
+    printf("sectors: %u positions compared\n", compared);
+}
+
+void test_slope() {
+    for(uint8_t degrees=1; degrees<45; degrees++) {
+        double reference = tan(radians((double)degrees)) * POLAR_SLOPE_45;
+        check(fabs(polar_slope(degrees) - reference) <= 0.5, "slope of %u degrees", degrees);
+    }
+    check(polar_slope(22.5) == POLAR_SLOPE_22_5, "slope of 22.5 degrees");
+    check(polar_slope(45) == POLAR_SLOPE_45, "slope of 45 degrees");
+    check(polar_slope(0) == 0, "slope of 0 degrees");
+}
+
+int main() {
+    test_isqrt();
+    test_magnitude();
+    test_slope();
+    test_sectors();
+    return test_result("polar");
+}
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The ring shared by a producer and a consumer thread.
+
+Each item carries a sequence number and values derived from it, so the
+consumer can tell if an item arrived out of order, twice, or partially
+written. First the producer retries when the ring is full, so every item must
+arrive. Then it drops them, so the items that arrive must still be in order,
+and together with the dropped count must account for all of them.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "ring.h"
+
+#define ITEMS 500000
+#define SLOTS 16
+
+typedef struct Item_struct {
+    uint32_t seq;
+    uint32_t check[5];
+} Item;
+
+Item item_buffer[SLOTS];
+Ring ring;
+bool retry;
+volatile bool producer_done;
+
+Item item_make(uint32_t seq) {
+    Item item = {seq, {0,}};
+    for(uint8_t i=0; i<5; i++) item.check[i] = (seq * 2654435761u) ^ i;
+    return item;
+}
+
+bool item_valid(Item *item) {
+    Item expected = item_make(item->seq);
+    for(uint8_t i=0; i<5; i++) {
+        if (item->check[i] != expected.check[i]) return false;
+    }
+    return true;
+}
+
+void *producer(void *arg) {
+    for(uint32_t seq=0; seq<ITEMS; seq++) {
+        Item item = item_make(seq);
+        while(!ring_push(&ring, &item) && retry) sched_yield();
+    }
+    __atomic_store_n(&producer_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void consume(uint32_t *received, uint32_t *invalid, uint32_t *unordered) {
+    Item item;
+    int64_t last = -1;
+    while(true) {
+        bool done = __atomic_load_n(&producer_done, __ATOMIC_ACQUIRE);
+        bool popped = false;
+        while(ring_pop(&ring, &item)) {
+            popped = true;
+            (*received)++;
+            if (!item_valid(&item)) (*invalid)++;
+            if ((int64_t)item.seq <= last) (*unordered)++;
+            last = item.seq;
+        }
+        if (done && !popped) break;
+        if (!popped) sched_yield();
+    }
+}
+
+void run(bool with_retry) {
+    ring = Ring_(item_buffer, sizeof(Item), SLOTS);
+    retry = with_retry;
+    producer_done = false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, NULL);
+    uint32_t received = 0;
+    uint32_t invalid = 0;
+    uint32_t unordered = 0;
+    consume(&received, &invalid, &unordered);
+    pthread_join(thread, NULL);
+    printf(
+        "retry=%i received=%u dropped=%u\n",
+        with_retry, received, ring.dropped
+    );
+    check(invalid == 0, "%u items partially written", invalid);
+    check(unordered == 0, "%u items out of order", unordered);
+    check(ring_len(&ring) == 0, "ring not empty");
+    if (with_retry) {
+        check(received == ITEMS, "received %u of %u", received, ITEMS);
+    } else {
+        check(
+            received + ring.dropped == ITEMS,
+            "received %u + dropped %u != %u", received, ring.dropped, ITEMS
+        );
+    }
+}
+
+void test_single_thread() {
+    ring = Ring_(item_buffer, sizeof(Item), SLOTS);
+    Item item = item_make(0);
+    check(!ring_pop(&ring, &item), "pop from empty ring");
+    for(uint32_t i=0; i<SLOTS; i++) {
+        item = item_make(i);
+        check(ring_push(&ring, &item), "push %u", i);
+    }
+    item = item_make(SLOTS);
+    check(!ring_push(&ring, &item), "push into full ring");
+    check(ring.dropped == 1, "dropped %u", ring.dropped);
+    check(ring_len(&ring) == SLOTS, "len %u", ring_len(&ring));
+    check(ring_pop(&ring, &item) && item.seq == 0, "pop oldest first");
+    ring_clear(&ring);
+    check(ring_len(&ring) == 0, "len after clear %u", ring_len(&ring));
+    check(!ring_pop(&ring, &item), "pop after clear");
+}
+
+int main() {
+    test_single_thread();
+    run(true);
+    run(false);
+    return test_result("ring");
+}
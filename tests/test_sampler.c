@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The dual-core sampler, with core 1 running as a thread.
+
+The fake IMU produces a known sequence of gyro samples much faster than the
+consumer drains them, so the ring is overrun most of the time. The rotation
+integrated by the consumer (gyro * dt) must still match the rotation that was
+produced, since the dropped samples are carried into the next pushed one.
+*/
+
+#include <math.h>
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include "test.h"
+#include "config.h"
+#include "sampler.h"
+#include "ring.h"
+
+#define SAMPLES 200000
+
+extern SamplerSample sampler_buffer[];
+extern Ring sampler_ring;
+extern volatile bool sampler_running;
+extern SamplerSample sampler_latest;
+void sampler_core1();
+
+// Written by the producer thread only, read once it is done.
+uint32_t produced = 0;
+double produced_gyro[3] = {0, 0, 0};
+uint64_t produced_dt = 0;
+volatile bool produced_done = false;
+
+ImuSample imu_read_sample() {
+    ImuSample sample = {{0, 0, 0}, {0, 0, 0}, 0, 0};
+    if (produced == SAMPLES) return sample;
+    uint32_t i = produced;
+    sample.gyro = (Vector){(i % 7) - 3.0, 0.25 * (i % 13), -1000.0 + (i % 101)};
+    sample.dt = 500 + (i % 50);
+    produced_gyro[0] += (double)sample.gyro.x * sample.dt;
+    produced_gyro[1] += (double)sample.gyro.y * sample.dt;
+    produced_gyro[2] += (double)sample.gyro.z * sample.dt;
+    produced_dt += sample.dt;
+    produced++;
+    if (produced == SAMPLES) __atomic_store_n(&produced_done, true, __ATOMIC_RELEASE);
+    return sample;
+}
+
+uint16_t thumbstick_adc_raw(uint8_t adc_index) {
+    return 0;
+}
+
+uint32_t touch_get_elapsed() {
+    return 0;
+}
+
+void info(char *msg, ...) {}
+
+int main() {
+    // As sampler_init() does when CFG_DUAL_CORE is set.
+    sampler_ring = Ring_(sampler_buffer, sizeof(SamplerSample), SAMPLER_RING_SLOTS);
+    sampler_running = true;
+    multicore_launch_core1(sampler_core1);
+
+    double integrated[3] = {0, 0, 0};
+    uint64_t integrated_dt = 0;
+    uint32_t ticks = 0;
+    uint32_t idle_ticks = 0;
+    // After the producer is done, keep draining until the carry has been
+    // flushed by a sample that covers no time.
+    while(idle_ticks < 100) {
+        if (__atomic_load_n(&produced_done, __ATOMIC_ACQUIRE)) idle_ticks++;
+        sleep_us(50);
+        sampler_update();
+        ImuSample sample = sampler_read_imu();
+        integrated[0] += (double)sample.gyro.x * sample.dt;
+        integrated[1] += (double)sample.gyro.y * sample.dt;
+        integrated[2] += (double)sample.gyro.z * sample.dt;
+        integrated_dt += sample.dt;
+        ticks++;
+    }
+    sampler_pause();
+
+    printf(
+        "samples=%u ticks=%u dropped=%u\n",
+        produced, ticks, sampler_ring.dropped
+    );
+    check(sampler_ring.dropped > 0, "the ring was never overrun");
+    check(
+        integrated_dt == produced_dt,
+        "dt integrated %llu, produced %llu",
+        (unsigned long long)integrated_dt, (unsigned long long)produced_dt
+    );
+    for(uint8_t i=0; i<3; i++) {
+        double error = fabs(integrated[i] - produced_gyro[i]);
+        double scale = fabs(produced_gyro[i]) + produced_dt;
+        printf("axis=%u produced=%.1f integrated=%.1f\n", i, produced_gyro[i], integrated[i]);
+        check(error / scale < 1e-4, "axis %u rotation error %f", i, error);
+    }
+    return test_result("sampler");
+}
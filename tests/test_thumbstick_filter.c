@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+Replay of synthetic thumbstick traces through the adaptive (One-Euro) filter.
+
+Each trace is the stick resting with ADC noise, then flicked to the edge, then
+moved slowly in a circle. For a few filter settings the jitter at rest (RMS,
+compared with the raw noise), the latency added to the flick (ticks until 90%
+of the way, compared with no filter) and the lag while moving slowly are
+reported, and checked against the limits the filter is meant to stay within.
+*/
+
+#include <math.h>
+#include "test.h"
+#include "config.h"
+#include "thumbstick.h"
+
+#define TICKS 1000  // Per part of the trace.
+#define NOISE 0.005f  // Peak ADC noise (unit value).
+#define DT (1000000 / CFG_TICK_FREQUENCY)
+
+typedef struct Result_struct {
+    float jitter;
+    float jitter_raw;
+    uint32_t latency;
+    float lag;
+} Result;
+
+// Deterministic noise in the range -amplitude to +amplitude.
+float noise(uint32_t *seed, float amplitude) {
+    *seed = (*seed * 1664525) + 1013904223;
+    return (((float)(*seed >> 8) / (1 << 24)) * 2 - 1) * amplitude;
+}
+
+Result replay(float cutoff, float beta) {
+    ThumbstickFilter filter = {.min_cutoff = cutoff, .beta = beta};
+    thumbstick_filter_reset(&filter);
+    uint32_t seed = 1;
+    Result result = {0, 0, 0, 0};
+    bool reached = false;
+    for(uint32_t i=0; i<TICKS*3; i++) {
+        float x;
+        float y;
+        if (i < TICKS) {
+            x = 0;
+            y = 0;
+        } else if (i < TICKS*2) {
+            x = 1;
+            y = 0;
+        } else {
+            // Half a turn per second, at half the radius.
+            float angle = (float)(i - TICKS*2) / CFG_TICK_FREQUENCY * M_PI;
+            x = cosf(angle) * 0.5f;
+            y = sinf(angle) * 0.5f;
+        }
+        float ideal_x = x;
+        float ideal_y = y;
+        x += noise(&seed, NOISE);
+        y += noise(&seed, NOISE);
+        float raw_x = x;
+        thumbstick_filter(&filter, &x, &y, DT);
+        if (i < TICKS) {
+            result.jitter += x * x;
+            result.jitter_raw += raw_x * raw_x;
+        } else if (i < TICKS*2) {
+            if (x >= 0.9f) reached = true;
+            if (!reached) result.latency++;
+        } else if (i >= TICKS*2 + (CFG_TICK_FREQUENCY / 10)) {
+            // After settling into the movement.
+            float error = hypotf(x - ideal_x, y - ideal_y);
+            result.lag = fmaxf(result.lag, error);
+        }
+    }
+    result.jitter = sqrtf(result.jitter / TICKS);
+    result.jitter_raw = sqrtf(result.jitter_raw / TICKS);
+    return result;
+}
+
+void test_settings() {
+    float settings[][2] = {{1, 5}, {2, 5}, {5, 5}, {5, 10}};
+    Result raw = replay(0, 0);
+    for(uint8_t i=0; i<4; i++) {
+        float cutoff = settings[i][0];
+        float beta = settings[i][1];
+        Result result = replay(cutoff, beta);
+        uint32_t added = result.latency - raw.latency;
+        printf(
+            "cutoff=%.1f beta=%.1f jitter=%.5f (raw %.5f) latency=+%u ms lag=%.4f\n",
+            cutoff, beta, result.jitter, result.jitter_raw,
+            added * CFG_TICK_INTERVAL, result.lag
+        );
+        check(result.jitter < result.jitter_raw / 2, "jitter not halved at cutoff %.1f", cutoff);
+        check(added * CFG_TICK_INTERVAL <= 16, "flick latency +%u ms at cutoff %.1f", added, cutoff);
+        check(result.lag < 0.05, "lag %.4f at cutoff %.1f", result.lag, cutoff);
+    }
+}
+
+// A zero cutoff (existing profiles) leaves the values untouched.
+void test_disabled() {
+    ThumbstickFilter filter = {.min_cutoff = 0, .beta = 0};
+    thumbstick_filter_reset(&filter);
+    uint32_t seed = 2;
+    uint32_t changed = 0;
+    for(uint32_t i=0; i<TICKS; i++) {
+        float x = noise(&seed, 1);
+        float y = noise(&seed, 1);
+        float in_x = x;
+        float in_y = y;
+        thumbstick_filter(&filter, &x, &y, DT);
+        if (x != in_x || y != in_y) changed++;
+    }
+    check(changed == 0, "disabled filter changed %u values", changed);
+}
+
+// A long gap between reports restarts the filter from the current position.
+void test_restart() {
+    ThumbstickFilter filter = {.min_cutoff = 1, .beta = 0};
+    thumbstick_filter_reset(&filter);
+    float x = 0;
+    float y = 0;
+    for(uint32_t i=0; i<TICKS; i++) {
+        x = 0;
+        y = 0;
+        thumbstick_filter(&filter, &x, &y, DT);
+    }
+    x = 1;
+    y = -1;
+    thumbstick_filter(&filter, &x, &y, CFG_THUMBSTICK_FILTER_DT_MAX + 1);
+    check(x == 1 && y == -1, "not restarted after a gap, x=%f y=%f", x, y);
+}
+
+int main() {
+    test_settings();
+    test_disabled();
+    test_restart();
+    return test_result("thumbstick_filter");
+}
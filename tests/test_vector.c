@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The single precision vector and quaternion functions against the same
+formulas in double precision.
+
+Random unit vectors and rotations are run through both, and the largest
+difference of any component is reported. The chained test applies many small
+rotations in a row, as the gyro does every tick, to see how far the rounding
+accumulates.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "vector.h"
+
+#define ROUNDS 1000000
+#define CHAIN 100000
+#define TOLERANCE 1e-5
+#define CHAIN_TOLERANCE 1e-3
+
+typedef struct {double x; double y; double z;} Vectord;
+typedef struct {double x; double y; double z; double r;} Vector4d;
+
+Vectord normalized(Vectord v) {
+    double mag = (v.x*v.x) + (v.y*v.y) + (v.z*v.z);
+    if (fabs(mag - 1.0) > 0.0001) {
+        mag = sqrt(mag);
+        return (Vectord){v.x/mag, v.y/mag, v.z/mag};
+    }
+    return v;
+}
+
+Vectord crossd(Vectord a, Vectord b) {
+    return (Vectord){
+        (a.y * b.z) - (a.z * b.y),
+        (a.z * b.x) - (a.x * b.z),
+        (a.x * b.y) - (a.y * b.x)
+    };
+}
+
+Vector4d quaterniond(Vectord v, double rotation) {
+    v = normalized(v);
+    double theta = rotation / 2;
+    return (Vector4d){v.x * sin(theta), v.y * sin(theta), v.z * sin(theta), cos(theta)};
+}
+
+Vector4d qmultiplyd(Vector4d q1, Vector4d q2) {
+    return (Vector4d){
+        q1.r * q2.x + q1.x * q2.r + q1.y * q2.z - q1.z * q2.y,
+        q1.r * q2.y + q1.y * q2.r + q1.z * q2.x - q1.x * q2.z,
+        q1.r * q2.z + q1.z * q2.r + q1.x * q2.y - q1.y * q2.x,
+        q1.r * q2.r - q1.x * q2.x - q1.y * q2.y - q1.z * q2.z
+    };
+}
+
+Vector4d qnormalized(Vector4d q) {
+    double mag = sqrt((q.x*q.x) + (q.y*q.y) + (q.z*q.z) + (q.r*q.r));
+    return (Vector4d){q.x/mag, q.y/mag, q.z/mag, q.r/mag};
+}
+
+Vectord qrotated(Vector4d q, Vectord v) {
+    Vector4d p = {v.x, v.y, v.z, 0};
+    Vector4d c = {-q.x, -q.y, -q.z, q.r};
+    Vector4d r = qmultiplyd(qmultiplyd(q, p), c);
+    return normalized((Vectord){r.x, r.y, r.z});
+}
+
+double random_unit() {
+    return ((rand() / (double)RAND_MAX) * 2) - 1;
+}
+
+Vectord random_vector() {
+    return (Vectord){random_unit(), random_unit(), random_unit()};
+}
+
+Vector single(Vectord v) {
+    return (Vector){v.x, v.y, v.z};
+}
+
+Vector4 single4(Vector4d q) {
+    return (Vector4){q.x, q.y, q.z, q.r};
+}
+
+double error(Vector v, Vectord reference) {
+    return fmax(fabs(v.x - reference.x), fmax(fabs(v.y - reference.y), fabs(v.z - reference.z)));
+}
+
+double error4(Vector4 q, Vector4d reference) {
+    return fmax(error((Vector){q.x, q.y, q.z}, (Vectord){reference.x, reference.y, reference.z}), fabs(q.r - reference.r));
+}
+
+void report(const char *name, double worst, double tolerance) {
+    printf("%-10s worst error=%.2e\n", name, worst);
+    check(worst < tolerance, "%s error %e", name, worst);
+}
+
+void test_functions() {
+    double worst_normalize = 0;
+    double worst_cross = 0;
+    double worst_lenght = 0;
+    double worst_quaternion = 0;
+    double worst_qmultiply = 0;
+    double worst_qrotate = 0;
+    srand(1);
+    for(uint32_t i=0; i<ROUNDS; i++) {
+        Vectord a = random_vector();
+        Vectord b = normalized(random_vector());
+        double angle = random_unit() * M_PI;
+        // Inputs are rounded to single precision first, so only the
+        // functions themselves are compared.
+        a = (Vectord){(float)a.x, (float)a.y, (float)a.z};
+        b = (Vectord){(float)b.x, (float)b.y, (float)b.z};
+        angle = (float)angle;
+        double lenght = sqrt((a.x*a.x) + (a.y*a.y) + (a.z*a.z));
+        if (lenght < 0.01) continue;
+        worst_normalize = fmax(worst_normalize, error(vector_normalize(single(a)), normalized(a)));
+        worst_cross = fmax(worst_cross, error(vector_cross_product(single(a), single(b)), crossd(a, b)));
+        worst_lenght = fmax(worst_lenght, fabs(vector_lenght(single(a)) - lenght));
+        Vector4d q1 = quaterniond(a, angle);
+        Vector4d q2 = quaterniond(b, -angle / 3);
+        worst_quaternion = fmax(worst_quaternion, error4(quaternion(single(a), angle), q1));
+        Vector4 q1f = single4(q1);
+        Vector4 q2f = single4(q2);
+        q1 = (Vector4d){q1f.x, q1f.y, q1f.z, q1f.r};
+        q2 = (Vector4d){q2f.x, q2f.y, q2f.z, q2f.r};
+        worst_qmultiply = fmax(worst_qmultiply, error4(qmultiply(q1f, q2f), qmultiplyd(q1, q2)));
+        worst_qrotate = fmax(worst_qrotate, error(qrotate(q1f, single(b)), qrotated(q1, b)));
+    }
+    report("normalize", worst_normalize, TOLERANCE);
+    report("cross", worst_cross, TOLERANCE);
+    report("lenght", worst_lenght, TOLERANCE);
+    report("quaternion", worst_quaternion, TOLERANCE);
+    report("qmultiply", worst_qmultiply, TOLERANCE);
+    report("qrotate", worst_qrotate, TOLERANCE);
+}
+
+void test_chain() {
+    Vector4 q = {0, 0, 0, 1};
+    Vector4d qd = {0, 0, 0, 1};
+    srand(2);
+    for(uint32_t i=0; i<CHAIN; i++) {
+        Vectord axis = random_vector();
+        if ((axis.x*axis.x) + (axis.y*axis.y) + (axis.z*axis.z) < 0.01) continue;
+        double angle = random_unit() * 0.01;
+        axis = (Vectord){(float)axis.x, (float)axis.y, (float)axis.z};
+        angle = (float)angle;
+        q = qnormalize(qmultiply(quaternion(single(axis), angle), q));
+        qd = qnormalized(qmultiplyd(quaterniond(axis, angle), qd));
+    }
+    // Where the X axis ends up, as the angle between both versions.
+    Vector x = qrotate(q, (Vector){1, 0, 0});
+    Vectord xd = qrotated(qd, (Vectord){1, 0, 0});
+    Vectord cross = crossd((Vectord){x.x, x.y, x.z}, xd);
+    double drift = asin(fmin(1, sqrt((cross.x*cross.x) + (cross.y*cross.y) + (cross.z*cross.z))));
+    printf("chain      %u rotations, drift=%.2e rad\n", CHAIN, drift);
+    check(drift < CHAIN_TOLERANCE, "chained drift %e rad", drift);
+}
+
+int main() {
+    test_functions();
+    test_chain();
+    return test_result("vector");
+}
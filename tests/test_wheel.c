@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// Copyright (C) 2022, Input Labs Oy.
+
+/*
+The timing wheel driven by a fake clock.
+
+Events are scheduled at random times with random delays (including delays
+longer than the wheel covers, which are clamped), while the clock moves
+forward in random steps as the main loop ticks would. Each event must fire
+exactly once, in the first advance that reaches its due time, with events due
+at the same time firing in the order they were scheduled. The clock starts
+close to the 32 bits overflow, so it wraps during the test.
+*/
+
+#include <stdlib.h>
+#include "test.h"
+#include "wheel.h"
+
+#define ROUNDS 200000
+
+typedef struct Record_struct {
+    uint32_t seq;
+    uint32_t due;
+    uint32_t fired;
+    uint32_t fired_at;
+} Record;
+
+Record records[ROUNDS];
+uint32_t records_len = 0;
+Wheel wheel;
+uint32_t now;
+uint32_t previous_now;
+uint32_t late = 0;
+uint32_t early = 0;
+uint32_t unordered = 0;
+Record *last_fired = NULL;
+
+void fired(uint8_t action, void *arg) {
+    Record *record = arg;
+    record->fired++;
+    record->fired_at = now;
+    // Fired in the advance that reached the due time, not before or after.
+    if ((int32_t)(now - record->due) < 0) early++;
+    if ((int32_t)(previous_now - record->due) >= 0) late++;
+    if (last_fired && last_fired->fired_at == now) {
+        bool before = (int32_t)(last_fired->due - record->due) < 0;
+        bool same = last_fired->due == record->due && last_fired->seq < record->seq;
+        if (!before && !same) unordered++;
+    }
+    last_fired = record;
+}
+
+bool schedule(uint32_t at, uint16_t delay) {
+    Record *record = &records[records_len];
+    uint32_t start = (int32_t)(at - wheel.time) < 0 ? wheel.time : at;
+    uint32_t due = start + (delay < 1 ? 1 : delay);
+    if (due - wheel.time > WHEEL_DELAY_MAX) due = wheel.time + WHEEL_DELAY_MAX;
+    *record = (Record){records_len, due, 0, 0};
+    if (!wheel_add(&wheel, at, delay, 0, record)) return false;
+    records_len++;
+    return true;
+}
+
+void test_random() {
+    now = 0xFFFFFFFF - 100000;
+    previous_now = now;
+    wheel_init(&wheel, now);
+    srand(1);
+    uint32_t rejected = 0;
+    while(records_len < ROUNDS) {
+        // Events are added at some point during the tick, ahead of the wheel.
+        uint32_t at = now + (rand() % 3);
+        uint16_t delay = (rand() % 8) ? rand() % 200 : rand() % 5000;
+        uint8_t n = rand() % 4;
+        for(uint8_t i=0; i<n && records_len < ROUNDS; i++) {
+            if (!schedule(at, delay)) rejected++;
+        }
+        previous_now = now;
+        now += 1 + (rand() % 20);
+        wheel_advance(&wheel, now, fired);
+    }
+    for(uint16_t i=0; i<(WHEEL_DELAY_MAX / 10) + 1; i++) {
+        previous_now = now;
+        now += 10;
+        wheel_advance(&wheel, now, fired);
+    }
+    uint32_t missing = 0;
+    uint32_t repeated = 0;
+    for(uint32_t i=0; i<records_len; i++) {
+        if (records[i].fired == 0) missing++;
+        if (records[i].fired > 1) repeated++;
+    }
+    printf(
+        "random: scheduled=%u rejected=%u dropped=%u\n",
+        records_len, rejected, wheel.dropped
+    );
+    check(missing == 0, "%u events never fired", missing);
+    check(repeated == 0, "%u events fired more than once", repeated);
+    check(early == 0, "%u events fired early", early);
+    check(late == 0, "%u events fired late", late);
+    check(unordered == 0, "%u events out of order", unordered);
+    check(rejected == wheel.dropped, "rejected %u dropped %u", rejected, wheel.dropped);
+    check(wheel_available(&wheel) == WHEEL_EVENTS, "%u events leaked", WHEEL_EVENTS - wheel_available(&wheel));
+}
+
+void test_full() {
+    now = 1000;
+    previous_now = now;
+    records_len = 0;
+    last_fired = NULL;
+    wheel_init(&wheel, now);
+    for(uint16_t i=0; i<WHEEL_EVENTS; i++) {
+        check(schedule(now, 10), "add %u", i);
+    }
+    check(!schedule(now, 10), "add into full wheel");
+    check(wheel.dropped == 1, "dropped %u", wheel.dropped);
+    check(wheel_available(&wheel) == 0, "available %u", wheel_available(&wheel));
+    previous_now = now;
+    now += 10;
+    wheel_advance(&wheel, now, fired);
+    check(wheel_available(&wheel) == WHEEL_EVENTS, "available %u", wheel_available(&wheel));
+    check(records[WHEEL_EVENTS - 1].fired == 1, "last event fired %u times", records[WHEEL_EVENTS - 1].fired);
+}
+
+int main() {
+    test_random();
+    test_full();
+    return test_result("wheel");
+}